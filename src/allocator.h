@@ -0,0 +1,367 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "device.h"
+#include "utils.h"
+
+// Linear resources (buffers) and optimal-tiling images must not share a
+// bufferImageGranularity page, so every sub-allocation remembers its kind.
+enum class ResourceKind : uint8_t {
+    free,
+    linear,
+    optimal,
+};
+
+inline VkDeviceSize align_up(VkDeviceSize val, VkDeviceSize alignment) {
+    return (val + alignment - 1) / alignment * alignment;
+}
+
+inline VkDeviceSize align_down(VkDeviceSize val, VkDeviceSize alignment) {
+    return val / alignment * alignment;
+}
+
+class MemoryBlock;
+
+struct Allocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    // points into the persistent mapping of host visible blocks, nullptr otherwise
+    void* mapped = nullptr;
+    uint32_t memory_type = 0;
+    MemoryBlock* block = nullptr;
+};
+
+struct MemoryStats {
+    uint32_t block_count = 0;
+    uint32_t allocation_count = 0;
+    uint32_t free_range_count = 0;
+    VkDeviceSize bytes_reserved = 0;
+    VkDeviceSize bytes_used = 0;
+    VkDeviceSize largest_free_range = 0;
+
+    // 0 when all free memory is one contiguous range, approaching 1 the more it is scattered
+    float fragmentation() const noexcept {
+        auto free_bytes = bytes_reserved - bytes_used;
+        if (free_bytes == 0) {
+            return 0.0f;
+        }
+        return 1.0f - static_cast<float>(largest_free_range) / static_cast<float>(free_bytes);
+    }
+
+    MemoryStats& operator+=(const MemoryStats& other) noexcept {
+        block_count += other.block_count;
+        allocation_count += other.allocation_count;
+        free_range_count += other.free_range_count;
+        bytes_reserved += other.bytes_reserved;
+        bytes_used += other.bytes_used;
+        largest_free_range = std::max(largest_free_range, other.largest_free_range);
+        return *this;
+    }
+};
+
+struct AllocatorStats {
+    MemoryStats total;
+    std::vector<MemoryStats> per_type;
+    uint32_t device_allocations = 0;
+};
+
+class MemoryBlock {
+    private:
+        struct Range {
+            VkDeviceSize size;
+            ResourceKind kind;
+        };
+    public:
+        MemoryBlock(VkDevice dev, uint32_t mem_type, VkDeviceSize size, VkDeviceSize granularity, bool host_visible) :
+            dev_{dev},
+            memory_{VK_NULL_HANDLE},
+            mapped_{nullptr},
+            size_{size},
+            granularity_{granularity},
+            mem_type_{mem_type},
+            used_{0}
+        {
+            auto malloc_info = VkMemoryAllocateInfo{};
+            malloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            malloc_info.allocationSize = size;
+            malloc_info.memoryTypeIndex = mem_type;
+
+            if (auto res = vkAllocateMemory(dev_, &malloc_info, nullptr, &memory_); res != VK_SUCCESS) {
+                throw VulkanError("Error allocating Memory", res);
+            }
+            if (host_visible) {
+                if (auto res = vkMapMemory(dev_, memory_, 0, VK_WHOLE_SIZE, 0, &mapped_); res != VK_SUCCESS) {
+                    vkFreeMemory(dev_, memory_, nullptr);
+                    throw VulkanError("Error mapping Memory", res);
+                }
+            }
+
+            ranges_.emplace(0, Range{size, ResourceKind::free});
+            free_by_size_.emplace(size, 0);
+        }
+
+        ~MemoryBlock() {
+            if (mapped_ != nullptr) {
+                vkUnmapMemory(dev_, memory_);
+            }
+            vkFreeMemory(dev_, memory_, nullptr);
+        }
+
+        MemoryBlock(const MemoryBlock&) = delete;
+        MemoryBlock& operator=(const MemoryBlock&) = delete;
+
+        // best fit over the free ranges, honoring alignment and bufferImageGranularity
+        bool allocate(VkDeviceSize size, VkDeviceSize alignment, ResourceKind kind, Allocation* alloc) {
+            for (auto it = free_by_size_.lower_bound(size); it != free_by_size_.end(); ++it) {
+                auto range = ranges_.find(it->second);
+                auto offset = fit(range, size, alignment, kind);
+                if (!offset) {
+                    continue;
+                }
+
+                auto range_begin = range->first;
+                auto range_end = range_begin + range->second.size;
+                free_by_size_.erase(it);
+                ranges_.erase(range);
+
+                if (*offset > range_begin) {
+                    insert_free(range_begin, *offset - range_begin);
+                }
+                ranges_.emplace(*offset, Range{size, kind});
+                if (*offset + size < range_end) {
+                    insert_free(*offset + size, range_end - (*offset + size));
+                }
+
+                used_ += size;
+                alloc->memory = memory_;
+                alloc->offset = *offset;
+                alloc->size = size;
+                alloc->mapped = (mapped_ != nullptr) ? static_cast<uint8_t*>(mapped_) + *offset : nullptr;
+                alloc->memory_type = mem_type_;
+                alloc->block = this;
+                return true;
+            }
+            return false;
+        }
+
+        void free(const Allocation& alloc) {
+            auto it = ranges_.find(alloc.offset);
+            if (it == ranges_.end() || it->second.kind == ResourceKind::free) {
+                return;
+            }
+            used_ -= it->second.size;
+
+            auto begin = it->first;
+            auto end = begin + it->second.size;
+
+            // coalesce with the free neighbours
+            if (it != ranges_.begin()) {
+                auto prev = std::prev(it);
+                if (prev->second.kind == ResourceKind::free) {
+                    erase_free(prev);
+                    begin = prev->first;
+                    ranges_.erase(prev);
+                }
+            }
+            auto next = std::next(it);
+            if (next != ranges_.end() && next->second.kind == ResourceKind::free) {
+                end = next->first + next->second.size;
+                erase_free(next);
+                ranges_.erase(next);
+            }
+            ranges_.erase(it);
+            insert_free(begin, end - begin);
+        }
+
+        bool empty() const noexcept {
+            return used_ == 0;
+        }
+
+        VkDeviceSize size() const noexcept {
+            return size_;
+        }
+
+        MemoryStats stats() const noexcept {
+            auto ret = MemoryStats{};
+            ret.block_count = 1;
+            ret.bytes_reserved = size_;
+            ret.bytes_used = used_;
+            ret.free_range_count = static_cast<uint32_t>(free_by_size_.size());
+            ret.allocation_count = static_cast<uint32_t>(ranges_.size() - free_by_size_.size());
+            if (!free_by_size_.empty()) {
+                ret.largest_free_range = free_by_size_.rbegin()->first;
+            }
+            return ret;
+        }
+
+    private:
+        using RangeIter = std::map<VkDeviceSize, Range>::iterator;
+
+        std::optional<VkDeviceSize> fit(RangeIter range, VkDeviceSize size, VkDeviceSize alignment, ResourceKind kind) const {
+            auto offset = align_up(range->first, alignment);
+
+            // a neighbour of the other kind sharing our first page pushes us onto the next one
+            if (range != ranges_.begin()) {
+                auto prev = std::prev(range);
+                if (conflicts(prev->second.kind, kind) && on_same_page(prev->first + prev->second.size - 1, offset)) {
+                    offset = align_up(offset, granularity_);
+                }
+            }
+
+            auto range_end = range->first + range->second.size;
+            if (offset + size > range_end) {
+                return std::nullopt;
+            }
+
+            // ...while one sharing our last page makes the range unusable
+            auto next = std::next(range);
+            if (next != ranges_.end() && conflicts(next->second.kind, kind) && on_same_page(offset + size - 1, next->first)) {
+                return std::nullopt;
+            }
+            return offset;
+        }
+
+        static bool conflicts(ResourceKind a, ResourceKind b) noexcept {
+            return a != ResourceKind::free && b != ResourceKind::free && a != b;
+        }
+
+        bool on_same_page(VkDeviceSize a_end, VkDeviceSize b_begin) const noexcept {
+            return align_down(a_end, granularity_) == align_down(b_begin, granularity_);
+        }
+
+        void insert_free(VkDeviceSize offset, VkDeviceSize size) {
+            ranges_.emplace(offset, Range{size, ResourceKind::free});
+            free_by_size_.emplace(size, offset);
+        }
+
+        void erase_free(RangeIter range) {
+            auto [first, last] = free_by_size_.equal_range(range->second.size);
+            for (auto it = first; it != last; ++it) {
+                if (it->second == range->first) {
+                    free_by_size_.erase(it);
+                    return;
+                }
+            }
+        }
+
+        VkDevice dev_;
+        VkDeviceMemory memory_;
+        void* mapped_;
+        VkDeviceSize size_;
+        VkDeviceSize granularity_;
+        uint32_t mem_type_;
+        VkDeviceSize used_;
+        // every range of the block keyed by offset, used and free alike
+        std::map<VkDeviceSize, Range> ranges_;
+        std::multimap<VkDeviceSize, VkDeviceSize> free_by_size_;
+};
+
+// Hands out sub-allocations of large VkDeviceMemory blocks, one block list per memory type.
+// Requests larger than half a block get a dedicated block which is released as soon as it is freed.
+class DeviceAllocator {
+    public:
+        static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+
+        void init(VulkanDevice dev, VkDeviceSize block_size = DEFAULT_BLOCK_SIZE) {
+            dev_ = dev;
+            vkGetPhysicalDeviceMemoryProperties(dev_.physical, &mem_props_);
+
+            auto dev_props = VkPhysicalDeviceProperties{};
+            vkGetPhysicalDeviceProperties(dev_.physical, &dev_props);
+            granularity_ = std::max<VkDeviceSize>(dev_props.limits.bufferImageGranularity, 1);
+
+            block_sizes_.resize(mem_props_.memoryTypeCount);
+            for (uint32_t i=0; i<mem_props_.memoryTypeCount; ++i) {
+                // keep small heaps (e.g. the 256MiB BAR heap) from being eaten by a few blocks
+                auto heap_size = mem_props_.memoryHeaps[mem_props_.memoryTypes[i].heapIndex].size;
+                block_sizes_[i] = std::min(block_size, heap_size / 8);
+            }
+            blocks_.resize(mem_props_.memoryTypeCount);
+        }
+
+        void destroy() {
+            blocks_.clear();
+            device_allocations_ = 0;
+        }
+
+        Allocation allocate(const VkMemoryRequirements& reqs, VkMemoryPropertyFlags props, ResourceKind kind) {
+            auto mem_type = find_memory_type(dev_.physical, reqs.memoryTypeBits, props);
+            auto& blocks = blocks_[mem_type];
+            auto ret = Allocation{};
+
+            auto alignment = std::max<VkDeviceSize>(reqs.alignment, 1);
+            if (reqs.size <= block_sizes_[mem_type] / 2) {
+                for (auto& block : blocks) {
+                    if (block->allocate(reqs.size, alignment, kind, &ret)) {
+                        return ret;
+                    }
+                }
+            }
+
+            auto block_size = std::max(block_sizes_[mem_type], reqs.size);
+            auto& block = blocks.emplace_back(std::make_unique<MemoryBlock>(
+                dev_.logical, mem_type, block_size, granularity_, is_host_visible(mem_type)
+            ));
+            ++device_allocations_;
+            block->allocate(reqs.size, alignment, kind, &ret);
+            return ret;
+        }
+
+        void free(Allocation& alloc) {
+            if (alloc.block == nullptr) {
+                return;
+            }
+            alloc.block->free(alloc);
+
+            // keep one empty block per type around so alloc/free cycles do not hit the driver
+            auto& blocks = blocks_[alloc.memory_type];
+            if (alloc.block->empty()) {
+                auto empty_cnt = std::count_if(blocks.begin(), blocks.end(), [](const auto& block) {
+                    return block->empty();
+                });
+                auto dedicated = alloc.block->size() > block_sizes_[alloc.memory_type];
+                if (dedicated || empty_cnt > 1) {
+                    blocks.erase(std::find_if(blocks.begin(), blocks.end(), [&](const auto& block) {
+                        return block.get() == alloc.block;
+                    }));
+                    --device_allocations_;
+                }
+            }
+            alloc = Allocation{};
+        }
+
+        AllocatorStats stats() const {
+            auto ret = AllocatorStats{};
+            ret.per_type.resize(blocks_.size());
+            for (size_t i=0; i<blocks_.size(); ++i) {
+                for (const auto& block : blocks_[i]) {
+                    ret.per_type[i] += block->stats();
+                }
+                ret.total += ret.per_type[i];
+            }
+            ret.device_allocations = device_allocations_;
+            return ret;
+        }
+
+    private:
+        bool is_host_visible(uint32_t mem_type) const noexcept {
+            return (mem_props_.memoryTypes[mem_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+        }
+
+        VulkanDevice dev_;
+        VkPhysicalDeviceMemoryProperties mem_props_;
+        VkDeviceSize granularity_ = 1;
+        std::vector<VkDeviceSize> block_sizes_;
+        std::vector<std::vector<std::unique_ptr<MemoryBlock>>> blocks_;
+        uint32_t device_allocations_ = 0;
+};
@@ -0,0 +1,277 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "renderer.h"
+
+// Renders fixed scenes headless for a set number of frames and prints the
+// timings as JSON, e.g. `vulkan_bench --frames 500 --out result.json`.
+// `--threads N` runs every scene once per recording thread count in
+// 1, 2, 4, ... N to show how command recording scales with cores.
+
+struct BenchScene {
+    std::string name;
+    SceneDesc desc;
+    VkExtent2D extent;
+};
+
+struct BenchArgs {
+    uint32_t frames = 300;
+    uint32_t warmup = 30;
+    uint32_t threads = 1;
+    uint32_t frames_in_flight = FrameScheduler::DEFAULT_FRAMES_IN_FLIGHT;
+    bool gpu_culling = true;
+    bool bindless = true;
+    bool sort_draws = true;
+    float timestep = 1.0f / 60.0f;
+    std::string only;
+    std::filesystem::path out;
+    // drawn by every scene instead of the quad
+    std::filesystem::path mesh;
+};
+
+const std::vector<BenchScene> scenes = {
+    BenchScene{"single_quad", SceneDesc{1, 256}, VkExtent2D{800, 600}},
+    BenchScene{"many_objects", SceneDesc{4096, 256}, VkExtent2D{1280, 720}},
+    BenchScene{"instanced_100k", SceneDesc{100000, 256}, VkExtent2D{1280, 720}},
+    BenchScene{"many_textures", SceneDesc{4096, 256, 256}, VkExtent2D{1280, 720}},
+    BenchScene{"large_texture", SceneDesc{16, 4096}, VkExtent2D{1280, 720}},
+    BenchScene{"high_resolution", SceneDesc{64, 1024}, VkExtent2D{3840, 2160}},
+};
+
+struct Summary {
+    double mean;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+};
+
+Summary summarize(std::vector<double> samples) {
+    auto ret = Summary{};
+    if (samples.empty()) {
+        return ret;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&samples](double p) {
+        auto idx = static_cast<size_t>(p * static_cast<double>(samples.size() - 1) + 0.5);
+        return samples[std::min(idx, samples.size() - 1)];
+    };
+    for (auto s : samples) {
+        ret.mean += s;
+    }
+    ret.mean /= static_cast<double>(samples.size());
+    ret.p50 = percentile(0.50);
+    ret.p90 = percentile(0.90);
+    ret.p99 = percentile(0.99);
+    ret.max = samples.back();
+    return ret;
+}
+
+void write_summary(std::ostream& os, const Summary& s) {
+    os << "{\"mean\": " << s.mean
+       << ", \"p50\": " << s.p50
+       << ", \"p90\": " << s.p90
+       << ", \"p99\": " << s.p99
+       << ", \"max\": " << s.max << "}";
+}
+
+void write_gpu_stats(std::ostream& os, const GpuTimingStats& s) {
+    os << "{\"mean\": " << s.mean_ms
+       << ", \"p50\": " << s.p50_ms
+       << ", \"p95\": " << s.p95_ms
+       << ", \"max\": " << s.max_ms
+       << ", \"samples\": " << s.count << "}";
+}
+
+std::vector<uint32_t> thread_counts(uint32_t max_threads) {
+    auto ret = std::vector<uint32_t>{};
+    for (uint32_t n=1; n<max_threads; n*=2) {
+        ret.push_back(n);
+    }
+    ret.push_back(max_threads);
+    return ret;
+}
+
+void run_scene(const BenchScene& scene, uint32_t threads, const BenchArgs& args, std::ostream& os) {
+    auto desc = scene.desc;
+    desc.mesh = args.mesh;
+    auto renderer = VulkanRenderer(scene.extent);
+    renderer.set_scene(desc);
+    renderer.set_record_threads(threads);
+    renderer.set_frames_in_flight(args.frames_in_flight);
+    renderer.set_gpu_culling(args.gpu_culling);
+    renderer.set_bindless(args.bindless);
+    renderer.set_sort_draws(args.sort_draws);
+    renderer.set_fixed_timestep(args.timestep);
+    renderer.init();
+    auto upload = renderer.finish_initial_uploads();
+
+    for (uint32_t i=0; i<args.warmup; ++i) {
+        renderer.draw_frame();
+    }
+    // keep every measured frame, dropping the warmup samples
+    renderer.gpu_profiler().set_window(args.frames);
+
+    auto cpu_ms = std::vector<double>{};
+    auto record_ms = std::vector<double>{};
+    auto stall_ms = std::vector<double>{};
+    auto latency_ms = std::vector<double>{};
+    cpu_ms.reserve(args.frames);
+    record_ms.reserve(args.frames);
+    stall_ms.reserve(args.frames);
+    latency_ms.reserve(args.frames);
+    for (uint32_t i=0; i<args.frames; ++i) {
+        auto t0 = std::chrono::steady_clock::now();
+        renderer.draw_frame();
+        cpu_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+        record_ms.push_back(renderer.record_ms());
+        stall_ms.push_back(renderer.stall_ms());
+        latency_ms.push_back(renderer.latency_ms());
+    }
+    renderer.destroy();
+
+    auto mib_per_s = (upload.seconds > 0.0) ? (static_cast<double>(upload.bytes) / (1024.0 * 1024.0)) / upload.seconds : 0.0;
+
+    os << "    {\"name\": \"" << scene.name << "\""
+       << ", \"objects\": " << scene.desc.object_count
+       << ", \"texture_size\": " << scene.desc.texture_size
+       << ", \"textures\": " << scene.desc.texture_count
+       << ", \"bindless\": " << (renderer.bindless() ? "true" : "false")
+       << ", \"sorted\": " << (args.sort_draws ? "true" : "false")
+       << ", \"mesh\": \"" << (args.mesh.empty() ? std::string("quad") : args.mesh.filename().string()) << "\""
+       << ", \"width\": " << scene.extent.width
+       << ", \"height\": " << scene.extent.height
+       << ", \"frames\": " << args.frames
+       << ", \"threads\": " << threads
+       << ", \"frames_in_flight\": " << renderer.frames_in_flight()
+       << ",\n     \"cpu_frame_ms\": ";
+    write_summary(os, summarize(cpu_ms));
+    os << ",\n     \"record_ms\": ";
+    write_summary(os, summarize(record_ms));
+    os << ",\n     \"stall_ms\": ";
+    write_summary(os, summarize(stall_ms));
+    os << ",\n     \"latency_ms\": ";
+    write_summary(os, summarize(latency_ms));
+    os << ",\n     \"gpu_ms\": {";
+    auto first = true;
+    for (const auto* profiler : {&renderer.gpu_profiler(), &renderer.upload_profiler()}) {
+        for (const auto& name : profiler->names()) {
+            os << (first ? "" : ", ") << "\"" << name << "\": ";
+            write_gpu_stats(os, profiler->stats(name));
+            first = false;
+        }
+    }
+    os << "}"
+       << ",\n     \"upload\": {\"bytes\": " << upload.bytes
+       << ", \"ms\": " << upload.seconds * 1000.0
+       << ", \"mib_per_s\": " << mib_per_s << "}}";
+}
+
+BenchArgs parse_args(int argc, char* argv[]) {
+    auto ret = BenchArgs{};
+    for (int i=1; i<argc; ++i) {
+        auto arg = std::string_view(argv[i]);
+        auto has_value = (i+1 < argc);
+        if (arg == "--frames" && has_value) {
+            ret.frames = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--warmup" && has_value) {
+            ret.warmup = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--threads" && has_value) {
+            ret.threads = static_cast<uint32_t>(std::stoul(argv[++i]));
+            if (ret.threads == 0) {
+                ret.threads = std::max(std::thread::hardware_concurrency(), 1u);
+            }
+        } else if (arg == "--frames-in-flight" && has_value) {
+            ret.frames_in_flight = std::max(static_cast<uint32_t>(std::stoul(argv[++i])), 1u);
+        } else if (arg == "--no-cull") {
+            ret.gpu_culling = false;
+        } else if (arg == "--no-bindless") {
+            ret.bindless = false;
+        } else if (arg == "--no-sort") {
+            ret.sort_draws = false;
+        } else if (arg == "--mesh" && has_value) {
+            ret.mesh = std::filesystem::absolute(argv[++i]);
+        } else if (arg == "--timestep" && has_value) {
+            ret.timestep = std::stof(argv[++i]);
+        } else if (arg == "--scene" && has_value) {
+            ret.only = argv[++i];
+        } else if (arg == "--out" && has_value) {
+            ret.out = std::filesystem::absolute(argv[++i]);
+        } else if (arg == "--list") {
+            for (const auto& scene : scenes) {
+                std::cout << scene.name << std::endl;
+            }
+            std::exit(0);
+        } else {
+            throw std::runtime_error("unknown argument " + std::string(arg));
+        }
+    }
+    return ret;
+}
+
+int main(int argc, char* argv[]) {
+    auto args = BenchArgs{};
+    try {
+        args = parse_args(argc, argv);
+    }
+    catch (const std::exception& ex) {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+
+    // shaders are looked up next to the executable
+    chdir(std::filesystem::path(argv[0]).remove_filename().c_str());
+
+    auto json = std::ostringstream{};
+    json << "{\n  \"frames\": " << args.frames
+         << ",\n  \"warmup\": " << args.warmup
+         << ",\n  \"timestep\": " << args.timestep
+         << ",\n  \"max_threads\": " << args.threads
+         << ",\n  \"gpu_culling\": " << (args.gpu_culling ? "true" : "false")
+         << ",\n  \"scenes\": [\n";
+    try {
+        auto first = true;
+        for (const auto& scene : scenes) {
+            if (!args.only.empty() && args.only != scene.name) {
+                continue;
+            }
+            for (auto threads : thread_counts(args.threads)) {
+                if (!first) {
+                    json << ",\n";
+                }
+                first = false;
+                std::cerr << "running " << scene.name << " (" << threads << " threads)" << std::endl;
+                run_scene(scene, threads, args, json);
+            }
+        }
+    }
+    catch (const VulkanError& ex) {
+        std::cerr << ex.what() << std::endl;
+        std::cerr << "Errorcode: " << ex.get_error() << std::endl;
+        return 1;
+    }
+    catch (const std::exception& ex) {
+        std::cerr << "Unhandled exception: " << ex.what() << std::endl;
+        return 1;
+    }
+    json << "\n  ]\n}\n";
+
+    if (args.out.empty()) {
+        std::cout << json.str();
+    } else {
+        auto ofs = std::ofstream(args.out);
+        ofs << json.str();
+    }
+    return 0;
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "device.h"
+#include "utils.h"
+
+// Every texture in one descriptor array of its own set, addressed by slot
+// index from per-instance data, so draws sampling different textures share
+// one bind and can be batched together. The binding is partially bound and
+// updatable after bind, add() writes a slot while command buffers using the
+// set are pending. A removed slot goes back to the free list only once the
+// last submission that could sample it has completed.
+class BindlessTextures {
+    public:
+        static constexpr uint32_t DEFAULT_CAPACITY = 4096;
+
+        // VK_EXT_descriptor_indexing with the features the texture array relies on
+        static bool device_supports(VkPhysicalDevice dev) {
+            uint32_t ext_cnt = 0;
+            vkEnumerateDeviceExtensionProperties(dev, nullptr, &ext_cnt, nullptr);
+            auto exts = std::vector<VkExtensionProperties>(ext_cnt);
+            vkEnumerateDeviceExtensionProperties(dev, nullptr, &ext_cnt, exts.data());
+            auto has_ext = false;
+            for (const auto& ext : exts) {
+                has_ext = has_ext || std::strcmp(ext.extensionName, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) == 0;
+            }
+            if (!has_ext) {
+                return false;
+            }
+
+            auto indexing = VkPhysicalDeviceDescriptorIndexingFeaturesEXT{};
+            indexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+            auto features = VkPhysicalDeviceFeatures2{};
+            features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            features.pNext = &indexing;
+            vkGetPhysicalDeviceFeatures2(dev, &features);
+            return (
+                indexing.shaderSampledImageArrayNonUniformIndexing == VK_TRUE &&
+                indexing.runtimeDescriptorArray == VK_TRUE &&
+                indexing.descriptorBindingPartiallyBound == VK_TRUE &&
+                indexing.descriptorBindingSampledImageUpdateAfterBind == VK_TRUE &&
+                indexing.descriptorBindingUpdateUnusedWhilePending == VK_TRUE
+            );
+        }
+
+        // chain into VkDeviceCreateInfo::pNext of a device that passed device_supports()
+        static VkPhysicalDeviceDescriptorIndexingFeaturesEXT required_features() noexcept {
+            auto ret = VkPhysicalDeviceDescriptorIndexingFeaturesEXT{};
+            ret.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+            ret.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+            ret.runtimeDescriptorArray = VK_TRUE;
+            ret.descriptorBindingPartiallyBound = VK_TRUE;
+            ret.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+            ret.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+            return ret;
+        }
+
+        void init(VulkanDevice dev, uint32_t capacity = DEFAULT_CAPACITY) {
+            dev_ = dev;
+            capacity_ = capacity;
+            next_slot_ = 0;
+            create_layout();
+            create_pool();
+            create_set();
+        }
+
+        void destroy() {
+            vkDestroyDescriptorPool(dev_.logical, pool_, nullptr);
+            vkDestroyDescriptorSetLayout(dev_.logical, layout_, nullptr);
+            free_.clear();
+            retired_.clear();
+        }
+
+        VkDescriptorSetLayout layout() const noexcept {
+            return layout_;
+        }
+
+        const VkDescriptorSet& set() const noexcept {
+            return set_;
+        }
+
+        // slot sampling `view`, the view must outlive the slot
+        uint32_t add(VkImageView view, VkSampler sampler) {
+            auto slot = next_slot_;
+            if (!free_.empty()) {
+                slot = free_.back();
+                free_.pop_back();
+            } else if (next_slot_ < capacity_) {
+                ++next_slot_;
+            } else {
+                throw std::runtime_error("Bindless texture array is full");
+            }
+
+            auto img_info = VkDescriptorImageInfo{};
+            img_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            img_info.imageView = view;
+            img_info.sampler = sampler;
+
+            auto desc_write = VkWriteDescriptorSet{};
+            desc_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            desc_write.dstSet = set_;
+            desc_write.dstBinding = 0;
+            desc_write.dstArrayElement = slot;
+            desc_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            desc_write.descriptorCount = 1;
+            desc_write.pImageInfo = &img_info;
+            vkUpdateDescriptorSets(dev_.logical, 1, &desc_write, 0, nullptr);
+            return slot;
+        }
+
+        // `serial` is the last submission that may still sample the slot
+        void remove(uint32_t slot, uint64_t serial) {
+            retired_.push_back(Retired{slot, serial});
+        }
+
+        void reclaim(uint64_t completed_serial) {
+            while (!retired_.empty() && retired_.front().serial <= completed_serial) {
+                free_.push_back(retired_.front().slot);
+                retired_.pop_front();
+            }
+        }
+
+    private:
+        struct Retired {
+            uint32_t slot;
+            uint64_t serial;
+        };
+
+        void create_layout() {
+            auto binding = VkDescriptorSetLayoutBinding{};
+            binding.binding = 0;
+            binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            binding.descriptorCount = capacity_;
+            binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+            VkDescriptorBindingFlagsEXT binding_flags = (
+                VK_DESCRIPTOR_BINDING_FLAG_PARTIALLY_BOUND_BIT_EXT |
+                VK_DESCRIPTOR_BINDING_FLAG_UPDATE_AFTER_BIND_BIT_EXT |
+                VK_DESCRIPTOR_BINDING_FLAG_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT
+            );
+            auto flags_info = VkDescriptorSetLayoutBindingFlagsCreateInfoEXT{};
+            flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+            flags_info.bindingCount = 1;
+            flags_info.pBindingFlags = &binding_flags;
+
+            auto dsl_info = VkDescriptorSetLayoutCreateInfo{};
+            dsl_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+            dsl_info.pNext = &flags_info;
+            dsl_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+            dsl_info.bindingCount = 1;
+            dsl_info.pBindings = &binding;
+            if (auto res = vkCreateDescriptorSetLayout(dev_.logical, &dsl_info, nullptr, &layout_); res != VK_SUCCESS) {
+                throw VulkanError("Error creating bindless DescriptorSetLayout", res);
+            }
+        }
+
+        void create_pool() {
+            auto pool_size = VkDescriptorPoolSize{};
+            pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            pool_size.descriptorCount = capacity_;
+
+            auto pool_info = VkDescriptorPoolCreateInfo{};
+            pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+            pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+            pool_info.poolSizeCount = 1;
+            pool_info.pPoolSizes = &pool_size;
+            pool_info.maxSets = 1;
+            if (auto res = vkCreateDescriptorPool(dev_.logical, &pool_info, nullptr, &pool_); res != VK_SUCCESS) {
+                throw VulkanError("Error creating bindless DescriptorPool", res);
+            }
+        }
+
+        void create_set() {
+            auto set_info = VkDescriptorSetAllocateInfo{};
+            set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            set_info.descriptorPool = pool_;
+            set_info.descriptorSetCount = 1;
+            set_info.pSetLayouts = &layout_;
+            if (auto res = vkAllocateDescriptorSets(dev_.logical, &set_info, &set_); res != VK_SUCCESS) {
+                throw VulkanError("Error allocating bindless DescriptorSet", res);
+            }
+        }
+
+        VulkanDevice dev_;
+        VkDescriptorSetLayout layout_ = VK_NULL_HANDLE;
+        VkDescriptorPool pool_ = VK_NULL_HANDLE;
+        VkDescriptorSet set_ = VK_NULL_HANDLE;
+        uint32_t capacity_ = DEFAULT_CAPACITY;
+        uint32_t next_slot_ = 0;
+        std::vector<uint32_t> free_;
+        std::deque<Retired> retired_;
+};
@@ -1,59 +1,155 @@
 #pragma once
 
 #include <array>
+#include <cmath>
+#include <cstdint>
 #include <vector>
 
 #include <vulkan/vulkan.h>
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
 
-#include "command.h"
+#include "allocator.h"
 #include "device.h"
 #include "utils.h"
 
+// Layouts the vertex buffer can hold. The vertex shader reads the same float
+// inputs from both, in the packed one the input assembler expands them from
+// half-float positions, UNORM8 color and UNORM16 uv, which halves the bytes
+// fetched per vertex. Stored in mesh files, so values must not change.
+enum class VertexFormat : uint32_t {
+    full = 0,
+    packed = 1,
+};
+
 struct Vertex {
-    glm::vec2 pos;
+    glm::vec3 pos;
     glm::vec3 color;
     glm::vec2 uv;
 
     static
     VkVertexInputBindingDescription
-    get_binding_desc() {
-        auto ret = VkVertexInputBindingDescription{};
-        ret.binding = 0;
-        ret.stride = sizeof(Vertex);
-        ret.inputRate = VkVertexInputRate::VK_VERTEX_INPUT_RATE_VERTEX;
+    get_binding_desc(VertexFormat format = VertexFormat::full);
+
+    static
+    std::array<VkVertexInputAttributeDescription, 3>
+    get_attrib_desc(VertexFormat format = VertexFormat::full);
+};
+
+// 16 bytes against Vertex's 32. Positions are 4 halves because 3 component
+// 16 bit formats are optional as vertex input, w is unused like color's alpha.
+struct PackedVertex {
+    uint64_t pos;
+    uint32_t color;
+    uint32_t uv;
+
+    // whether `vert` survives packing: positions within half range, color and uv in [0, 1]
+    static bool fits(const Vertex& vert) noexcept {
+        auto in_unit = [](float val) {
+            return val >= 0.0f && val <= 1.0f;
+        };
+        for (int i=0; i<3; ++i) {
+            if (!(std::abs(vert.pos[i]) <= 65504.0f) || !in_unit(vert.color[i])) {
+                return false;
+            }
+        }
+        return in_unit(vert.uv.x) && in_unit(vert.uv.y);
+    }
 
+    static PackedVertex pack(const Vertex& vert) noexcept {
+        auto ret = PackedVertex{};
+        ret.pos = glm::packHalf4x16(glm::vec4(vert.pos, 1.0f));
+        ret.color = glm::packUnorm4x8(glm::vec4(vert.color, 1.0f));
+        ret.uv = glm::packUnorm2x16(vert.uv);
         return ret;
     }
+};
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex is part of the mesh file format");
 
-    static
-    std::array<VkVertexInputAttributeDescription, 3>
-    get_attrib_desc() {
-        std::array<VkVertexInputAttributeDescription, 3> ret;
-        ret[0].binding = 0;
-        ret[0].location = 0;
-        ret[0].format = VkFormat::VK_FORMAT_R32G32_SFLOAT;
+inline uint32_t vertex_stride(VertexFormat format) noexcept {
+    return (format == VertexFormat::packed) ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+inline
+VkVertexInputBindingDescription
+Vertex::get_binding_desc(VertexFormat format) {
+    auto ret = VkVertexInputBindingDescription{};
+    ret.binding = 0;
+    ret.stride = vertex_stride(format);
+    ret.inputRate = VkVertexInputRate::VK_VERTEX_INPUT_RATE_VERTEX;
+
+    return ret;
+}
+
+inline
+std::array<VkVertexInputAttributeDescription, 3>
+Vertex::get_attrib_desc(VertexFormat format) {
+    std::array<VkVertexInputAttributeDescription, 3> ret;
+    ret[0].binding = 0;
+    ret[0].location = 0;
+    ret[1].binding = 0;
+    ret[1].location = 1;
+    ret[2].binding = 0;
+    ret[2].location = 2;
+    // every format here is mandatory for vertex buffers
+    if (format == VertexFormat::packed) {
+        ret[0].format = VkFormat::VK_FORMAT_R16G16B16A16_SFLOAT;
+        ret[0].offset = offsetof(PackedVertex, pos);
+        ret[1].format = VkFormat::VK_FORMAT_R8G8B8A8_UNORM;
+        ret[1].offset = offsetof(PackedVertex, color);
+        ret[2].format = VkFormat::VK_FORMAT_R16G16_UNORM;
+        ret[2].offset = offsetof(PackedVertex, uv);
+    } else {
+        ret[0].format = VkFormat::VK_FORMAT_R32G32B32_SFLOAT;
         ret[0].offset = offsetof(Vertex, pos);
-        ret[1].binding = 0;
-        ret[1].location = 1;
         ret[1].format = VkFormat::VK_FORMAT_R32G32B32_SFLOAT;
         ret[1].offset = offsetof(Vertex, color);
-        ret[2].binding = 0;
-        ret[2].location = 2;
         ret[2].format = VkFormat::VK_FORMAT_R32G32_SFLOAT;
         ret[2].offset = offsetof(Vertex, uv);
+    }
+    return ret;
+}
+
+// Per-object data streamed at instance rate next to the vertex buffer, the
+// model matrix occupying four consecutive attribute locations. The culling
+// shader reads the same array as a std430 struct of a mat4 and a uvec4, so
+// the padding keeps the stride at 80 bytes.
+struct InstanceData {
+    glm::mat4 model;
+    // slot in the bindless texture array, ignored without bindless textures
+    uint32_t texture = 0;
+    uint32_t pad[3] = {};
+
+    static
+    VkVertexInputBindingDescription
+    get_binding_desc() {
+        auto ret = VkVertexInputBindingDescription{};
+        ret.binding = 1;
+        ret.stride = sizeof(InstanceData);
+        ret.inputRate = VkVertexInputRate::VK_VERTEX_INPUT_RATE_INSTANCE;
+
         return ret;
     }
-};
 
-inline const std::vector<Vertex> vertices = {
-    Vertex{{-0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}, {1.0f, 0.0f}},
-    Vertex{{0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
-    Vertex{{0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}, {0.0f, 1.0f}},
-    Vertex{{-0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}},
-};
+    static
+    std::array<VkVertexInputAttributeDescription, 5>
+    get_attrib_desc() {
+        std::array<VkVertexInputAttributeDescription, 5> ret;
+        for (uint32_t col=0; col<4; ++col) {
+            ret[col].binding = 1;
+            ret[col].location = 3 + col;
+            ret[col].format = VkFormat::VK_FORMAT_R32G32B32A32_SFLOAT;
+            ret[col].offset = static_cast<uint32_t>(offsetof(InstanceData, model) + col * sizeof(glm::vec4));
+        }
 
-inline const std::vector<uint16_t> indices = {0, 1, 2, 2, 3, 0};
+        ret[4].binding = 1;
+        ret[4].location = 7;
+        ret[4].format = VkFormat::VK_FORMAT_R32_UINT;
+        ret[4].offset = offsetof(InstanceData, texture);
+        return ret;
+    }
+};
+static_assert(sizeof(InstanceData) == 80, "InstanceData must match the culling shader's Instance");
 
 struct BufferDesc {
     VkDeviceSize size;
@@ -61,7 +157,7 @@ struct BufferDesc {
     VkMemoryPropertyFlags mem_prop_flags;
 };
 
-inline void create_buffer(const VulkanDevice dev, const BufferDesc& desc, VkBuffer* buf, VkDeviceMemory* mem) {
+inline void create_buffer(const VulkanDevice dev, DeviceAllocator& allocator, const BufferDesc& desc, VkBuffer* buf, Allocation* mem) {
     auto buf_info = VkBufferCreateInfo{};
     buf_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     buf_info.size = desc.size;
@@ -77,48 +173,37 @@ inline void create_buffer(const VulkanDevice dev, const BufferDesc& desc, VkBuff
 
     auto mem_reqs = VkMemoryRequirements{};
     vkGetBufferMemoryRequirements(dev.logical, *buf, &mem_reqs);
-    auto mem_props = VkPhysicalDeviceMemoryProperties{};
-    vkGetPhysicalDeviceMemoryProperties(dev.physical, &mem_props);
-
-    auto malloc_info = VkMemoryAllocateInfo{};
-    malloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    malloc_info.allocationSize = mem_reqs.size;
-    malloc_info.memoryTypeIndex = find_memory_type(
-        dev.physical, mem_reqs.memoryTypeBits,
-        desc.mem_prop_flags
-    );
+    *mem = allocator.allocate(mem_reqs, desc.mem_prop_flags, ResourceKind::linear);
 
-    {
-        auto res = vkAllocateMemory(dev.logical, &malloc_info, nullptr, mem);
-        if (res != VK_SUCCESS) {
-            throw VulkanError("Error allocating Memory", res);
-        }
-    }
-
-    vkBindBufferMemory(dev.logical, *buf, *mem, 0);
+    vkBindBufferMemory(dev.logical, *buf, mem->memory, mem->offset);
 }
 
-inline void copy_buffer(const VulkanDevice dev, VkQueue tx_queue, VkCommandPool cmd_pool, VkBuffer src_buf, VkBuffer dst_buf, VkDeviceSize size) {
-    auto mem_tx_buf = OneTimeCommandBuffer(dev.logical, cmd_pool);
-    auto cmd_executor = RAIICommandBufferExecutor(mem_tx_buf, tx_queue);
+inline void destroy_buffer(const VulkanDevice dev, DeviceAllocator& allocator, VkBuffer buf, Allocation& mem) {
+    vkDestroyBuffer(dev.logical, buf, nullptr);
+    allocator.free(mem);
+}
 
+inline void copy_buffer(VkCommandBuffer cmd_buf, VkBuffer src_buf, VkDeviceSize src_offset, VkBuffer dst_buf, VkDeviceSize dst_offset, VkDeviceSize size) {
     auto region = VkBufferCopy{};
-    region.srcOffset = 0;
-    region.dstOffset = 0;
+    region.srcOffset = src_offset;
+    region.dstOffset = dst_offset;
     region.size = size;
-    vkCmdCopyBuffer(mem_tx_buf, src_buf, dst_buf, 1, &region);
+    vkCmdCopyBuffer(cmd_buf, src_buf, dst_buf, 1, &region);
 }
 
-inline void copy_buffer_to_image(VkCommandBuffer cmd_buf, VkBuffer src_buf, VkImage dst_img, VkExtent3D extent) {
+inline void copy_buffer_to_image(
+    VkCommandBuffer cmd_buf, VkBuffer src_buf, VkDeviceSize src_offset,
+    VkImage dst_img, VkOffset3D offset, VkExtent3D extent, uint32_t mip_level = 0
+) {
     auto copy_region = VkBufferImageCopy{};
-    copy_region.bufferOffset = 0;
+    copy_region.bufferOffset = src_offset;
     copy_region.bufferRowLength = 0;
     copy_region.bufferImageHeight = 0;
-    copy_region.imageOffset = VkOffset3D{};
+    copy_region.imageOffset = offset;
     copy_region.imageExtent = extent;
     copy_region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     copy_region.imageSubresource.layerCount = 1;
     copy_region.imageSubresource.baseArrayLayer = 0;
-    copy_region.imageSubresource.mipLevel = 0;
+    copy_region.imageSubresource.mipLevel = mip_level;
     vkCmdCopyBufferToImage(cmd_buf, src_buf, dst_img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
 }
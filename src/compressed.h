@@ -0,0 +1,358 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "mapped_file.h"
+#include "texture.h"
+#include "utils.h"
+
+// Block-compressed texture with all of its mip levels, as stored by the
+// cooker. Level data is laid out exactly as vkCmdCopyBufferToImage expects
+// it and is read in place from a mapping of the file, so uploading is one
+// copy from the page cache into staging memory, with no decoding.
+// DDS (DXT1/DXT5 or a DX10 header) and uncompressed-container KTX2 files
+// holding BC1, BC3 or BC7 are understood.
+class CompressedTexture {
+    public:
+        struct Level {
+            size_t offset;
+            size_t size;
+            uint32_t width;
+            uint32_t height;
+        };
+
+        static constexpr uint32_t BLOCK_DIM = 4;
+
+        static CompressedTexture load(const std::filesystem::path& fpath) {
+            auto ret = CompressedTexture{};
+            ret.file_ = MappedFile(fpath, MappedFile::Access::sequential);
+            if (ret.file_.size() >= 4 && std::memcmp(ret.file_.data(), DDS_MAGIC, 4) == 0) {
+                ret.parse_dds();
+            } else if (ret.file_.size() >= KTX2_ID.size() && std::memcmp(ret.file_.data(), KTX2_ID.data(), KTX2_ID.size()) == 0) {
+                ret.parse_ktx2();
+            } else {
+                throw std::runtime_error("Unknown texture container " + fpath.string());
+            }
+            return ret;
+        }
+
+        // DDS with a DX10 header, `data` holds every level back to back starting with the largest
+        static void save_dds(
+            const std::filesystem::path& fpath, VkFormat format, uint32_t width, uint32_t height,
+            uint32_t mip_levels, const std::vector<uint8_t>& data
+        ) {
+            auto header = DdsHeader{};
+            header.size = sizeof(DdsHeader);
+            header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+            header.height = height;
+            header.width = width;
+            header.pitch_or_linear_size = static_cast<uint32_t>(level_size(format, width, height));
+            header.mip_map_count = mip_levels;
+            header.pixel_format.size = sizeof(DdsPixelFormat);
+            header.pixel_format.flags = DDPF_FOURCC;
+            header.pixel_format.four_cc = fourcc("DX10");
+            header.caps = DDSCAPS_TEXTURE | DDSCAPS_MIPMAP | DDSCAPS_COMPLEX;
+
+            auto dx10 = DdsHeaderDx10{};
+            dx10.dxgi_format = to_dxgi(format);
+            dx10.resource_dimension = DDS_DIMENSION_TEXTURE2D;
+            dx10.array_size = 1;
+
+            auto ofs = std::ofstream(fpath, std::ios::binary | std::ios::trunc);
+            ofs.write(DDS_MAGIC, 4);
+            ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            ofs.write(reinterpret_cast<const char*>(&dx10), sizeof(dx10));
+            ofs.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+            if (!ofs.flush()) {
+                throw std::runtime_error("Error writing " + fpath.string());
+            }
+        }
+
+        static uint32_t block_bytes(VkFormat format) noexcept {
+            switch (format) {
+                case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+                case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+                case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+                case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+                    return 8;
+                default:
+                    return 16;
+            }
+        }
+
+        static size_t level_size(VkFormat format, uint32_t width, uint32_t height) noexcept {
+            auto blocks_x = (width + BLOCK_DIM - 1) / BLOCK_DIM;
+            auto blocks_y = (height + BLOCK_DIM - 1) / BLOCK_DIM;
+            return size_t{blocks_x} * blocks_y * block_bytes(format);
+        }
+
+        // sampling `format` needs the textureCompressionBC feature and optimal tiling support
+        static bool device_supports(VkPhysicalDevice dev, VkFormat format) {
+            auto features = VkPhysicalDeviceFeatures{};
+            vkGetPhysicalDeviceFeatures(dev, &features);
+            if (features.textureCompressionBC != VK_TRUE) {
+                return false;
+            }
+            auto props = VkFormatProperties{};
+            vkGetPhysicalDeviceFormatProperties(dev, format, &props);
+            return (props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+        }
+
+        VkFormat format() const noexcept {
+            return format_;
+        }
+
+        uint32_t width() const noexcept {
+            return levels_.front().width;
+        }
+
+        uint32_t height() const noexcept {
+            return levels_.front().height;
+        }
+
+        uint32_t mip_levels() const noexcept {
+            return static_cast<uint32_t>(levels_.size());
+        }
+
+        const Level& level(uint32_t idx) const noexcept {
+            return levels_[idx];
+        }
+
+        // points into the file mapping, valid as long as the texture
+        const uint8_t* level_data(uint32_t idx) const noexcept {
+            return file_.data() + levels_[idx].offset;
+        }
+
+        // hands the level's pages back once it has been copied out, reading it again faults them back in
+        void release_level(uint32_t idx) const noexcept {
+            file_.release(levels_[idx].offset, levels_[idx].size);
+        }
+
+    private:
+        struct DdsPixelFormat {
+            uint32_t size;
+            uint32_t flags;
+            uint32_t four_cc;
+            uint32_t rgb_bit_count;
+            uint32_t masks[4];
+        };
+        struct DdsHeader {
+            uint32_t size;
+            uint32_t flags;
+            uint32_t height;
+            uint32_t width;
+            uint32_t pitch_or_linear_size;
+            uint32_t depth;
+            uint32_t mip_map_count;
+            uint32_t reserved1[11];
+            DdsPixelFormat pixel_format;
+            uint32_t caps;
+            uint32_t caps2;
+            uint32_t caps3;
+            uint32_t caps4;
+            uint32_t reserved2;
+        };
+        struct DdsHeaderDx10 {
+            uint32_t dxgi_format;
+            uint32_t resource_dimension;
+            uint32_t misc_flag;
+            uint32_t array_size;
+            uint32_t misc_flags2;
+        };
+        struct Ktx2Header {
+            uint32_t vk_format;
+            uint32_t type_size;
+            uint32_t pixel_width;
+            uint32_t pixel_height;
+            uint32_t pixel_depth;
+            uint32_t layer_count;
+            uint32_t face_count;
+            uint32_t level_count;
+            uint32_t supercompression_scheme;
+            uint32_t dfd_byte_offset;
+            uint32_t dfd_byte_length;
+            uint32_t kvd_byte_offset;
+            uint32_t kvd_byte_length;
+            // two uint64 in the file at offset 64, split so the struct has no padding
+            uint32_t sgd_byte_offset[2];
+            uint32_t sgd_byte_length[2];
+        };
+        struct Ktx2Level {
+            uint64_t byte_offset;
+            uint64_t byte_length;
+            uint64_t uncompressed_byte_length;
+        };
+
+        static constexpr const char* DDS_MAGIC = "DDS ";
+        static constexpr std::array<uint8_t, 12> KTX2_ID = {
+            0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+        };
+        static constexpr uint32_t DDSD_CAPS = 0x1;
+        static constexpr uint32_t DDSD_HEIGHT = 0x2;
+        static constexpr uint32_t DDSD_WIDTH = 0x4;
+        static constexpr uint32_t DDSD_PIXELFORMAT = 0x1000;
+        static constexpr uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+        static constexpr uint32_t DDSD_LINEARSIZE = 0x80000;
+        static constexpr uint32_t DDPF_FOURCC = 0x4;
+        static constexpr uint32_t DDSCAPS_COMPLEX = 0x8;
+        static constexpr uint32_t DDSCAPS_TEXTURE = 0x1000;
+        static constexpr uint32_t DDSCAPS_MIPMAP = 0x400000;
+        static constexpr uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+        static constexpr uint32_t DXGI_FORMAT_BC1_UNORM = 71;
+        static constexpr uint32_t DXGI_FORMAT_BC1_UNORM_SRGB = 72;
+        static constexpr uint32_t DXGI_FORMAT_BC3_UNORM = 77;
+        static constexpr uint32_t DXGI_FORMAT_BC3_UNORM_SRGB = 78;
+        static constexpr uint32_t DXGI_FORMAT_BC7_UNORM = 98;
+        static constexpr uint32_t DXGI_FORMAT_BC7_UNORM_SRGB = 99;
+
+        static constexpr uint32_t fourcc(const char (&code)[5]) noexcept {
+            return uint32_t(uint8_t(code[0])) | (uint32_t(uint8_t(code[1])) << 8) |
+                (uint32_t(uint8_t(code[2])) << 16) | (uint32_t(uint8_t(code[3])) << 24);
+        }
+
+        static VkFormat from_dxgi(uint32_t dxgi) {
+            switch (dxgi) {
+                case DXGI_FORMAT_BC1_UNORM: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+                case DXGI_FORMAT_BC1_UNORM_SRGB: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+                case DXGI_FORMAT_BC3_UNORM: return VK_FORMAT_BC3_UNORM_BLOCK;
+                case DXGI_FORMAT_BC3_UNORM_SRGB: return VK_FORMAT_BC3_SRGB_BLOCK;
+                case DXGI_FORMAT_BC7_UNORM: return VK_FORMAT_BC7_UNORM_BLOCK;
+                case DXGI_FORMAT_BC7_UNORM_SRGB: return VK_FORMAT_BC7_SRGB_BLOCK;
+                default: throw std::runtime_error("Unsupported DXGI format " + std::to_string(dxgi));
+            }
+        }
+
+        static uint32_t to_dxgi(VkFormat format) {
+            switch (format) {
+                case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+                case VK_FORMAT_BC1_RGBA_UNORM_BLOCK: return DXGI_FORMAT_BC1_UNORM;
+                case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+                case VK_FORMAT_BC1_RGBA_SRGB_BLOCK: return DXGI_FORMAT_BC1_UNORM_SRGB;
+                case VK_FORMAT_BC3_UNORM_BLOCK: return DXGI_FORMAT_BC3_UNORM;
+                case VK_FORMAT_BC3_SRGB_BLOCK: return DXGI_FORMAT_BC3_UNORM_SRGB;
+                case VK_FORMAT_BC7_UNORM_BLOCK: return DXGI_FORMAT_BC7_UNORM;
+                case VK_FORMAT_BC7_SRGB_BLOCK: return DXGI_FORMAT_BC7_UNORM_SRGB;
+                default: throw std::runtime_error("Format has no DDS equivalent");
+            }
+        }
+
+        static bool is_block_compressed(VkFormat format) noexcept {
+            switch (format) {
+                case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+                case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+                case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+                case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+                case VK_FORMAT_BC3_UNORM_BLOCK:
+                case VK_FORMAT_BC3_SRGB_BLOCK:
+                case VK_FORMAT_BC7_UNORM_BLOCK:
+                case VK_FORMAT_BC7_SRGB_BLOCK:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        template<typename T>
+        T read_at(size_t offset) const {
+            if (offset + sizeof(T) > file_.size()) {
+                throw std::runtime_error("Truncated texture file");
+            }
+            auto ret = T{};
+            std::memcpy(&ret, file_.data() + offset, sizeof(T));
+            return ret;
+        }
+
+        // rejects headers no image can be created from before any level is read
+        static void check_extent(uint32_t width, uint32_t height, uint32_t mips) {
+            if (width == 0 || height == 0) {
+                throw std::runtime_error("Texture has a zero width or height");
+            }
+            if (mips > mip_level_count(width, height)) {
+                throw std::runtime_error("Texture has more mip levels than its size allows");
+            }
+        }
+
+        // levels stored back to back from `offset`, largest first
+        void add_packed_levels(size_t offset, uint32_t width, uint32_t height, uint32_t count) {
+            for (uint32_t i=0; i<count; ++i) {
+                auto size = level_size(format_, width, height);
+                if (offset + size > file_.size()) {
+                    throw std::runtime_error("Truncated texture file");
+                }
+                levels_.push_back(Level{offset, size, width, height});
+                offset += size;
+                width = std::max(width / 2, 1u);
+                height = std::max(height / 2, 1u);
+            }
+        }
+
+        void parse_dds() {
+            auto header = read_at<DdsHeader>(4);
+            auto offset = 4 + sizeof(DdsHeader);
+            if ((header.pixel_format.flags & DDPF_FOURCC) == 0) {
+                throw std::runtime_error("Uncompressed DDS files are not supported");
+            }
+            // legacy fourccs carry no color space, color textures are sRGB here
+            if (header.pixel_format.four_cc == fourcc("DXT1")) {
+                format_ = VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+            } else if (header.pixel_format.four_cc == fourcc("DXT5")) {
+                format_ = VK_FORMAT_BC3_SRGB_BLOCK;
+            } else if (header.pixel_format.four_cc == fourcc("DX10")) {
+                auto dx10 = read_at<DdsHeaderDx10>(offset);
+                offset += sizeof(DdsHeaderDx10);
+                if (dx10.resource_dimension != DDS_DIMENSION_TEXTURE2D || dx10.array_size > 1) {
+                    throw std::runtime_error("Only single 2D DDS textures are supported");
+                }
+                format_ = from_dxgi(dx10.dxgi_format);
+            } else {
+                throw std::runtime_error("Unsupported DDS fourcc");
+            }
+            auto mips = ((header.flags & DDSD_MIPMAPCOUNT) != 0) ? std::max(header.mip_map_count, 1u) : 1u;
+            check_extent(header.width, header.height, mips);
+            add_packed_levels(offset, header.width, header.height, mips);
+        }
+
+        void parse_ktx2() {
+            auto header = read_at<Ktx2Header>(KTX2_ID.size());
+            format_ = static_cast<VkFormat>(header.vk_format);
+            if (!is_block_compressed(format_)) {
+                throw std::runtime_error("KTX2 file does not hold BC1, BC3 or BC7 data");
+            }
+            if (header.supercompression_scheme != 0) {
+                throw std::runtime_error("Supercompressed KTX2 files are not supported");
+            }
+            if (header.pixel_depth > 1 || header.layer_count > 1 || header.face_count != 1) {
+                throw std::runtime_error("Only single 2D KTX2 textures are supported");
+            }
+
+            auto index = KTX2_ID.size() + sizeof(Ktx2Header);
+            auto level_cnt = std::max(header.level_count, 1u);
+            check_extent(header.pixel_width, header.pixel_height, level_cnt);
+            auto width = header.pixel_width;
+            auto height = header.pixel_height;
+            for (uint32_t i=0; i<level_cnt; ++i) {
+                auto level = read_at<Ktx2Level>(index + i * sizeof(Ktx2Level));
+                auto expected = level_size(format_, width, height);
+                if (level.byte_length != expected || level.byte_offset + level.byte_length > file_.size()) {
+                    throw std::runtime_error("Corrupt KTX2 level index");
+                }
+                levels_.push_back(Level{static_cast<size_t>(level.byte_offset), expected, width, height});
+                width = std::max(width / 2, 1u);
+                height = std::max(height / 2, 1u);
+            }
+        }
+
+        MappedFile file_;
+        std::vector<Level> levels_;
+        VkFormat format_ = VK_FORMAT_UNDEFINED;
+};
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define STB_DXT_IMPLEMENTATION
+#include <stb_dxt.h>
+
+#include "compressed.h"
+#include "texture.h"
+
+// Offline texture cooker: decodes a source image, builds its mip chain and
+// block-compresses every level into a DDS the renderer uploads as is, e.g.
+// `texture_cooker texture.jpg texture.bc1.dds --format bc1`.
+
+struct CookArgs {
+    std::filesystem::path in;
+    std::filesystem::path out;
+    VkFormat format = VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+};
+
+// IN OUT [--format bc1|bc3]
+CookArgs parse_args(int argc, char* argv[]) {
+    auto ret = CookArgs{};
+    auto positional = std::vector<std::string_view>{};
+    for (int i=1; i<argc; ++i) {
+        auto arg = std::string_view(argv[i]);
+        if (arg == "--format" && i+1 < argc) {
+            auto fmt = std::string_view(argv[++i]);
+            if (fmt == "bc1") {
+                ret.format = VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+            } else if (fmt == "bc3") {
+                ret.format = VK_FORMAT_BC3_SRGB_BLOCK;
+            } else {
+                throw std::runtime_error("--format must be bc1 or bc3");
+            }
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (positional.size() != 2) {
+        throw std::runtime_error("usage: texture_cooker IN OUT [--format bc1|bc3]");
+    }
+    ret.in = positional[0];
+    ret.out = positional[1];
+    return ret;
+}
+
+// appends the blocks of one RGBA8 level, edge texels are repeated to fill partial blocks
+void compress_level(const uint8_t* pixels, uint32_t width, uint32_t height, VkFormat format, std::vector<uint8_t>& out) {
+    auto alpha = (format == VK_FORMAT_BC3_SRGB_BLOCK) ? 1 : 0;
+    auto block_bytes = CompressedTexture::block_bytes(format);
+    uint8_t block[16 * 4];
+    for (uint32_t by=0; by<height; by+=CompressedTexture::BLOCK_DIM) {
+        for (uint32_t bx=0; bx<width; bx+=CompressedTexture::BLOCK_DIM) {
+            for (uint32_t y=0; y<CompressedTexture::BLOCK_DIM; ++y) {
+                for (uint32_t x=0; x<CompressedTexture::BLOCK_DIM; ++x) {
+                    auto sx = std::min(bx + x, width - 1);
+                    auto sy = std::min(by + y, height - 1);
+                    std::copy_n(pixels + (size_t{sy} * width + sx) * 4, 4, block + (y * CompressedTexture::BLOCK_DIM + x) * 4);
+                }
+            }
+            auto offset = out.size();
+            out.resize(offset + block_bytes);
+            stb_compress_dxt_block(out.data() + offset, block, alpha, STB_DXT_HIGHQUAL);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        auto args = parse_args(argc, argv);
+        auto tex = Texture(args.in);
+
+        auto width = tex.width();
+        auto height = tex.height();
+        auto mip_levels = mip_level_count(width, height);
+
+        auto out = std::vector<uint8_t>{};
+        auto src = std::vector<uint8_t>(tex.data(), tex.data() + tex.size());
+        auto dst = std::vector<uint8_t>{};
+        for (uint32_t level=0; level<mip_levels; ++level) {
+            compress_level(src.data(), width, height, args.format, out);
+            if (level+1 == mip_levels) {
+                break;
+            }
+            auto dst_w = std::max(width / 2, 1u);
+            auto dst_h = std::max(height / 2, 1u);
+            dst.resize(size_t{dst_w} * dst_h * 4);
+            downsample_rgba8(src.data(), width, height, dst.data());
+            std::swap(src, dst);
+            width = dst_w;
+            height = dst_h;
+        }
+
+        CompressedTexture::save_dds(args.out, args.format, tex.width(), tex.height(), mip_levels, out);
+        std::cout << args.out.string() << ": " << tex.width() << "x" << tex.height() << ", "
+            << mip_levels << " levels, " << out.size() << " bytes" << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
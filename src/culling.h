@@ -0,0 +1,275 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+
+#include "allocator.h"
+#include "buffer.h"
+#include "descriptors.h"
+#include "device.h"
+#include "shader.h"
+#include "utils.h"
+
+// Frustum culling on the GPU. Compute passes test every instance's
+// bounding sphere against the frustum and compact the survivors into a
+// visible instance buffer, counting them in the instanceCount of a single
+// VkDrawIndexedIndirectCommand. All objects share one mesh, so the draw is
+// one vkCmdDrawIndexedIndirect whatever the object count, and the CPU never
+// needs to know how many objects were visible. Compaction is a prefix sum
+// (count per workgroup, scan the counts, scatter) rather than an atomic
+// append, so survivors keep the order they were submitted in, e.g. front to
+// back.
+class GpuCuller {
+    private:
+        struct PushConstants {
+            glm::vec4 planes[6];
+            uint32_t object_count;
+            float radius;
+            uint32_t pass;
+        };
+        struct Frame {
+            VkBuffer indirect;
+            Allocation indirect_mem;
+            VkBuffer visible = VK_NULL_HANDLE;
+            Allocation visible_mem;
+            // a visible count, then a first output slot, per workgroup
+            VkBuffer groups = VK_NULL_HANDLE;
+            Allocation groups_mem;
+            size_t capacity = 0;
+        };
+        // must match cull.comp.glsl
+        static constexpr uint32_t GROUP_SIZE = 64;
+        static constexpr uint32_t PASS_COUNT = 0;
+        static constexpr uint32_t PASS_SCAN = 1;
+        static constexpr uint32_t PASS_SCATTER = 2;
+    public:
+        // `radius` bounds the mesh in its own space, instance scale is applied on the GPU
+        void init(
+            VulkanDevice dev, DeviceAllocator& allocator, VkPipelineCache cache, DescriptorCache& descriptors,
+            uint32_t frame_cnt, float radius
+        ) {
+            dev_ = dev;
+            radius_ = radius;
+            create_layouts(descriptors);
+            create_pipeline(cache);
+
+            frames_.resize(frame_cnt);
+            auto buf_desc = BufferDesc{};
+            buf_desc.size = sizeof(VkDrawIndexedIndirectCommand);
+            buf_desc.buf_usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+            buf_desc.mem_prop_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+            for (auto& frame : frames_) {
+                create_buffer(dev_, allocator, buf_desc, &frame.indirect, &frame.indirect_mem);
+            }
+        }
+
+        void destroy(DeviceAllocator& allocator) {
+            for (auto& frame : frames_) {
+                if (frame.visible != VK_NULL_HANDLE) {
+                    destroy_buffer(dev_, allocator, frame.visible, frame.visible_mem);
+                    destroy_buffer(dev_, allocator, frame.groups, frame.groups_mem);
+                }
+                destroy_buffer(dev_, allocator, frame.indirect, frame.indirect_mem);
+            }
+            frames_.clear();
+            vkDestroyPipeline(dev_.logical, pipeline_, nullptr);
+            vkDestroyPipelineLayout(dev_.logical, layout_, nullptr);
+        }
+
+        // room for `capacity` visible instances, only once the frame's previous submission has completed
+        void reserve(DeviceAllocator& allocator, uint32_t frame_idx, size_t capacity) {
+            auto& frame = frames_[frame_idx];
+            if (capacity > frame.capacity) {
+                if (frame.visible != VK_NULL_HANDLE) {
+                    destroy_buffer(dev_, allocator, frame.visible, frame.visible_mem);
+                    destroy_buffer(dev_, allocator, frame.groups, frame.groups_mem);
+                }
+                auto buf_desc = BufferDesc{};
+                buf_desc.size = capacity * sizeof(InstanceData);
+                buf_desc.buf_usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+                buf_desc.mem_prop_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+                create_buffer(dev_, allocator, buf_desc, &frame.visible, &frame.visible_mem);
+                buf_desc.size = group_count(capacity) * sizeof(uint32_t);
+                buf_desc.buf_usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+                create_buffer(dev_, allocator, buf_desc, &frame.groups, &frame.groups_mem);
+                frame.capacity = capacity;
+            }
+        }
+
+        // compacted instances, bound at instance rate in place of the frame's instance buffer
+        VkBuffer visible_buffer(uint32_t frame_idx) const noexcept {
+            return frames_[frame_idx].visible;
+        }
+
+        VkBuffer indirect_buffer(uint32_t frame_idx) const noexcept {
+            return frames_[frame_idx].indirect;
+        }
+
+        // outside of a render pass; `mvp` maps the instances' space to clip space, the set binding
+        // `instances` comes from the frame's `descriptors` and is gone with their next reset
+        void record(
+            VkCommandBuffer cmd_buf, uint32_t frame_idx, DescriptorAllocator& descriptors, VkBuffer instances,
+            const glm::mat4& mvp, uint32_t index_count, uint32_t object_count
+        ) {
+            auto& frame = frames_[frame_idx];
+            auto desc_set = descriptors.allocate(set_layout_);
+            write_desc_set(desc_set, instances, frame);
+
+            // instanceCount is written by the scan pass
+            auto draw = VkDrawIndexedIndirectCommand{};
+            draw.indexCount = index_count;
+            draw.instanceCount = 0;
+            vkCmdUpdateBuffer(cmd_buf, frame.indirect, 0, sizeof(draw), &draw);
+
+            auto reset_barrier = VkMemoryBarrier{};
+            reset_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            reset_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            reset_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                1, &reset_barrier,
+                0, nullptr,
+                0, nullptr
+            );
+
+            auto push = PushConstants{};
+            auto planes = frustum_planes(mvp);
+            std::copy(planes.begin(), planes.end(), push.planes);
+            push.object_count = object_count;
+            push.radius = radius_;
+
+            auto pass_barrier = VkMemoryBarrier{};
+            pass_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            pass_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            pass_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+            vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_);
+            vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, layout_, 0, 1, &desc_set, 0, nullptr);
+            for (auto pass : {PASS_COUNT, PASS_SCAN, PASS_SCATTER}) {
+                if (pass != PASS_COUNT) {
+                    vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                        1, &pass_barrier,
+                        0, nullptr,
+                        0, nullptr
+                    );
+                }
+                push.pass = pass;
+                vkCmdPushConstants(cmd_buf, layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+                vkCmdDispatch(cmd_buf, (pass == PASS_SCAN) ? 1 : group_count(object_count), 1, 1);
+            }
+
+            auto cull_barrier = VkMemoryBarrier{};
+            cull_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            cull_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            cull_barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+            vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+                1, &cull_barrier,
+                0, nullptr,
+                0, nullptr
+            );
+        }
+
+        // normalized planes facing inwards, for Vulkan's 0..1 clip depth
+        static std::array<glm::vec4, 6> frustum_planes(const glm::mat4& m) {
+            auto row = [&m](int i) {
+                return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+            };
+            auto ret = std::array<glm::vec4, 6>{
+                row(3) + row(0),
+                row(3) - row(0),
+                row(3) + row(1),
+                row(3) - row(1),
+                row(2),
+                row(3) - row(2),
+            };
+            for (auto& plane : ret) {
+                plane /= glm::length(glm::vec3(plane));
+            }
+            return ret;
+        }
+
+    private:
+        static uint32_t group_count(size_t objects) noexcept {
+            return static_cast<uint32_t>((objects + GROUP_SIZE - 1) / GROUP_SIZE);
+        }
+
+        void write_desc_set(VkDescriptorSet desc_set, VkBuffer instances, const Frame& frame) {
+            auto buf_infos = std::array<VkDescriptorBufferInfo, 4>{
+                VkDescriptorBufferInfo{instances, 0, VK_WHOLE_SIZE},
+                VkDescriptorBufferInfo{frame.visible, 0, VK_WHOLE_SIZE},
+                VkDescriptorBufferInfo{frame.indirect, 0, VK_WHOLE_SIZE},
+                VkDescriptorBufferInfo{frame.groups, 0, VK_WHOLE_SIZE},
+            };
+            auto writes = std::array<VkWriteDescriptorSet, 4>{};
+            for (uint32_t i=0; i<writes.size(); ++i) {
+                writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                writes[i].dstSet = desc_set;
+                writes[i].dstBinding = i;
+                writes[i].dstArrayElement = 0;
+                writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                writes[i].descriptorCount = 1;
+                writes[i].pBufferInfo = &buf_infos[i];
+            }
+            vkUpdateDescriptorSets(dev_.logical, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+        }
+
+        void create_layouts(DescriptorCache& descriptors) {
+            auto bindings = std::vector<VkDescriptorSetLayoutBinding>(4);
+            for (uint32_t i=0; i<bindings.size(); ++i) {
+                bindings[i].binding = i;
+                bindings[i].descriptorCount = 1;
+                bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+            }
+            set_layout_ = descriptors.layout(bindings);
+
+            auto push_range = VkPushConstantRange{};
+            push_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+            push_range.offset = 0;
+            push_range.size = sizeof(PushConstants);
+
+            auto pl_layout_info = VkPipelineLayoutCreateInfo{};
+            pl_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+            pl_layout_info.setLayoutCount = 1;
+            pl_layout_info.pSetLayouts = &set_layout_;
+            pl_layout_info.pushConstantRangeCount = 1;
+            pl_layout_info.pPushConstantRanges = &push_range;
+            if (auto res = vkCreatePipelineLayout(dev_.logical, &pl_layout_info, nullptr, &layout_); res != VK_SUCCESS) {
+                throw VulkanError("Error creating PipelineLayout", res);
+            }
+        }
+
+        void create_pipeline(VkPipelineCache cache) {
+            auto module = create_shader_module(dev_.logical, load_file("cull.spv").bytes());
+
+            auto stage_info = VkPipelineShaderStageCreateInfo{};
+            stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            stage_info.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+            stage_info.module = module;
+            stage_info.pName = "main";
+
+            auto pipeline_info = VkComputePipelineCreateInfo{};
+            pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+            pipeline_info.stage = stage_info;
+            pipeline_info.layout = layout_;
+            auto res = vkCreateComputePipelines(dev_.logical, cache, 1, &pipeline_info, nullptr, &pipeline_);
+            vkDestroyShaderModule(dev_.logical, module, nullptr);
+            if (res != VK_SUCCESS) {
+                throw VulkanError("Error creating compute Pipeline", res);
+            }
+        }
+
+        VulkanDevice dev_;
+        float radius_ = 1.0f;
+        // owned by the DescriptorCache
+        VkDescriptorSetLayout set_layout_;
+        VkPipelineLayout layout_;
+        VkPipeline pipeline_;
+        std::vector<Frame> frames_;
+};
@@ -2,8 +2,14 @@
 
 #include <glm/glm.hpp>
 
+// per frame, view_proj is premultiplied on the CPU
 struct UniformBufferObject {
-    glm::mat4 model;
     glm::mat4 view;
     glm::mat4 proj;
+    glm::mat4 view_proj;
+};
+
+// per draw, pushed with vkCmdPushConstants instead of written to a buffer
+struct DrawPushConstants {
+    glm::mat4 mvp;
 };
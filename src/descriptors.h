@@ -0,0 +1,315 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "device.h"
+#include "utils.h"
+
+// Hands out descriptor sets from a chain of pools. When a pool runs out,
+// the next one is taken from the pools freed by reset(), or created with
+// twice the sets of the last, so allocation never fails for lack of pool
+// space. reset() recycles every pool at once with vkResetDescriptorPool;
+// an allocator kept per frame in flight and reset once the frame's fence
+// has signaled makes transient sets free to allocate. Not thread safe,
+// give each recording thread its own.
+class DescriptorAllocator {
+    public:
+        // descriptors of each type reserved per set in a pool
+        struct PoolRatio {
+            VkDescriptorType type;
+            float per_set;
+        };
+
+        static constexpr uint32_t DEFAULT_SETS_PER_POOL = 64;
+        static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+        void init(VulkanDevice dev, uint32_t sets_per_pool = DEFAULT_SETS_PER_POOL) {
+            init(dev, default_ratios(), sets_per_pool);
+        }
+
+        void init(VulkanDevice dev, std::vector<PoolRatio> ratios, uint32_t sets_per_pool = DEFAULT_SETS_PER_POOL) {
+            dev_ = dev;
+            ratios_ = std::move(ratios);
+            sets_per_pool_ = std::max(sets_per_pool, 1u);
+        }
+
+        void destroy() {
+            for (auto pool : used_) {
+                vkDestroyDescriptorPool(dev_.logical, pool, nullptr);
+            }
+            for (auto pool : free_) {
+                vkDestroyDescriptorPool(dev_.logical, pool, nullptr);
+            }
+            if (current_ != VK_NULL_HANDLE) {
+                vkDestroyDescriptorPool(dev_.logical, current_, nullptr);
+            }
+            used_.clear();
+            free_.clear();
+            current_ = VK_NULL_HANDLE;
+        }
+
+        VkDescriptorSet allocate(VkDescriptorSetLayout layout) {
+            if (current_ == VK_NULL_HANDLE) {
+                current_ = next_pool();
+            }
+
+            auto set_info = VkDescriptorSetAllocateInfo{};
+            set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            set_info.descriptorSetCount = 1;
+            set_info.pSetLayouts = &layout;
+
+            auto ret = VkDescriptorSet{};
+            set_info.descriptorPool = current_;
+            auto res = vkAllocateDescriptorSets(dev_.logical, &set_info, &ret);
+            if (res == VK_ERROR_OUT_OF_POOL_MEMORY || res == VK_ERROR_FRAGMENTED_POOL) {
+                used_.push_back(current_);
+                current_ = next_pool();
+                set_info.descriptorPool = current_;
+                res = vkAllocateDescriptorSets(dev_.logical, &set_info, &ret);
+            }
+            if (res != VK_SUCCESS) {
+                throw VulkanError("Error allocating DescriptorSet", res);
+            }
+            return ret;
+        }
+
+        // every set allocated so far becomes invalid, their last use must have completed
+        void reset() {
+            if (current_ != VK_NULL_HANDLE) {
+                used_.push_back(current_);
+                current_ = VK_NULL_HANDLE;
+            }
+            for (auto pool : used_) {
+                vkResetDescriptorPool(dev_.logical, pool, 0);
+                free_.push_back(pool);
+            }
+            used_.clear();
+        }
+
+    private:
+        static std::vector<PoolRatio> default_ratios() {
+            return {
+                PoolRatio{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f},
+                PoolRatio{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f},
+                PoolRatio{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3.0f},
+                PoolRatio{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2.0f},
+            };
+        }
+
+        VkDescriptorPool next_pool() {
+            if (!free_.empty()) {
+                auto ret = free_.back();
+                free_.pop_back();
+                return ret;
+            }
+
+            auto pool_sizes = std::vector<VkDescriptorPoolSize>{};
+            for (const auto& ratio : ratios_) {
+                auto count = static_cast<uint32_t>(ratio.per_set * static_cast<float>(sets_per_pool_));
+                pool_sizes.push_back(VkDescriptorPoolSize{ratio.type, std::max(count, 1u)});
+            }
+
+            auto pool_info = VkDescriptorPoolCreateInfo{};
+            pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+            pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+            pool_info.pPoolSizes = pool_sizes.data();
+            pool_info.maxSets = sets_per_pool_;
+
+            auto ret = VkDescriptorPool{};
+            if (auto res = vkCreateDescriptorPool(dev_.logical, &pool_info, nullptr, &ret); res != VK_SUCCESS) {
+                throw VulkanError("Error creating DescriptorPool", res);
+            }
+            sets_per_pool_ = std::min(sets_per_pool_ * 2, MAX_SETS_PER_POOL);
+            return ret;
+        }
+
+        VulkanDevice dev_;
+        std::vector<PoolRatio> ratios_;
+        uint32_t sets_per_pool_ = DEFAULT_SETS_PER_POOL;
+        VkDescriptorPool current_ = VK_NULL_HANDLE;
+        std::vector<VkDescriptorPool> used_;
+        std::vector<VkDescriptorPool> free_;
+};
+
+// One descriptor of a set written by DescriptorCache::immutable_set().
+struct DescriptorWrite {
+    uint32_t binding;
+    VkDescriptorType type;
+    VkDescriptorBufferInfo buffer{};
+    VkDescriptorImageInfo image{};
+
+    static DescriptorWrite buffer_info(uint32_t binding, VkDescriptorType type, VkBuffer buf, VkDeviceSize range = VK_WHOLE_SIZE) {
+        auto ret = DescriptorWrite{binding, type};
+        ret.buffer = VkDescriptorBufferInfo{buf, 0, range};
+        return ret;
+    }
+
+    static DescriptorWrite image_info(uint32_t binding, VkImageView view, VkSampler sampler) {
+        auto ret = DescriptorWrite{binding, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER};
+        ret.image = VkDescriptorImageInfo{sampler, view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        return ret;
+    }
+
+    bool is_image() const noexcept {
+        return type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    }
+};
+
+// Set layouts and sets whose contents never change, deduplicated by a hash
+// of their description. Asking twice for the same bindings or the same
+// writes returns the same handle, so layouts can be requested wherever they
+// are needed and a set per texture or buffer combination is written once.
+// Cached sets live until destroy(), they come from a growing pool chain.
+class DescriptorCache {
+    public:
+        void init(VulkanDevice dev) {
+            dev_ = dev;
+            allocator_.init(dev_);
+        }
+
+        void destroy() {
+            for (const auto& [hash, entries] : layouts_) {
+                for (const auto& entry : entries) {
+                    vkDestroyDescriptorSetLayout(dev_.logical, entry.layout, nullptr);
+                }
+            }
+            layouts_.clear();
+            sets_.clear();
+            allocator_.destroy();
+        }
+
+        VkDescriptorSetLayout layout(std::vector<VkDescriptorSetLayoutBinding> bindings) {
+            std::sort(bindings.begin(), bindings.end(), [](const auto& a, const auto& b) { return a.binding < b.binding; });
+            auto hash = FNV_OFFSET;
+            for (const auto& binding : bindings) {
+                hash = mix(hash, binding.binding);
+                hash = mix(hash, binding.descriptorType);
+                hash = mix(hash, binding.descriptorCount);
+                hash = mix(hash, binding.stageFlags);
+                hash = mix(hash, binding.pImmutableSamplers);
+            }
+
+            auto& entries = layouts_[hash];
+            for (const auto& entry : entries) {
+                if (same_bindings(entry.bindings, bindings)) {
+                    return entry.layout;
+                }
+            }
+
+            auto dsl_info = VkDescriptorSetLayoutCreateInfo{};
+            dsl_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+            dsl_info.bindingCount = static_cast<uint32_t>(bindings.size());
+            dsl_info.pBindings = bindings.data();
+            auto ret = VkDescriptorSetLayout{};
+            if (auto res = vkCreateDescriptorSetLayout(dev_.logical, &dsl_info, nullptr, &ret); res != VK_SUCCESS) {
+                throw VulkanError("Error creating DescriptorSetLayout", res);
+            }
+            entries.push_back(LayoutEntry{std::move(bindings), ret});
+            return ret;
+        }
+
+        // a set of `layout` holding `writes`, each written only the first time it is asked for
+        VkDescriptorSet immutable_set(VkDescriptorSetLayout layout, const std::vector<DescriptorWrite>& writes) {
+            auto hash = mix(FNV_OFFSET, layout);
+            for (const auto& write : writes) {
+                hash = mix(hash, write.binding);
+                hash = mix(hash, write.type);
+                if (write.is_image()) {
+                    hash = mix(hash, write.image.imageView);
+                    hash = mix(hash, write.image.sampler);
+                } else {
+                    hash = mix(hash, write.buffer.buffer);
+                    hash = mix(hash, write.buffer.offset);
+                    hash = mix(hash, write.buffer.range);
+                }
+            }
+
+            auto& entries = sets_[hash];
+            for (const auto& entry : entries) {
+                if (entry.layout == layout && same_writes(entry.writes, writes)) {
+                    return entry.set;
+                }
+            }
+
+            auto ret = allocator_.allocate(layout);
+            auto vk_writes = std::vector<VkWriteDescriptorSet>(writes.size());
+            for (size_t i=0; i<writes.size(); ++i) {
+                vk_writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                vk_writes[i].dstSet = ret;
+                vk_writes[i].dstBinding = writes[i].binding;
+                vk_writes[i].dstArrayElement = 0;
+                vk_writes[i].descriptorType = writes[i].type;
+                vk_writes[i].descriptorCount = 1;
+                if (writes[i].is_image()) {
+                    vk_writes[i].pImageInfo = &writes[i].image;
+                } else {
+                    vk_writes[i].pBufferInfo = &writes[i].buffer;
+                }
+            }
+            vkUpdateDescriptorSets(dev_.logical, static_cast<uint32_t>(vk_writes.size()), vk_writes.data(), 0, nullptr);
+            entries.push_back(SetEntry{layout, writes, ret});
+            return ret;
+        }
+
+    private:
+        struct LayoutEntry {
+            std::vector<VkDescriptorSetLayoutBinding> bindings;
+            VkDescriptorSetLayout layout;
+        };
+        struct SetEntry {
+            VkDescriptorSetLayout layout;
+            std::vector<DescriptorWrite> writes;
+            VkDescriptorSet set;
+        };
+
+        static constexpr uint64_t FNV_OFFSET = 14695981039346656037ull;
+
+        template<typename T>
+        static uint64_t mix(uint64_t hash, T value) noexcept {
+            auto bits = uint64_t{0};
+            // non-dispatchable handles are pointers on 64-bit platforms and integers elsewhere
+            if constexpr (std::is_pointer_v<T>) {
+                bits = reinterpret_cast<uintptr_t>(value);
+            } else {
+                bits = static_cast<uint64_t>(value);
+            }
+            for (int i=0; i<8; ++i) {
+                hash = (hash ^ ((bits >> (8 * i)) & 0xff)) * 1099511628211ull;
+            }
+            return hash;
+        }
+
+        static bool same_bindings(const std::vector<VkDescriptorSetLayoutBinding>& a, const std::vector<VkDescriptorSetLayoutBinding>& b) {
+            return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const auto& x, const auto& y) {
+                return (
+                    x.binding == y.binding && x.descriptorType == y.descriptorType &&
+                    x.descriptorCount == y.descriptorCount && x.stageFlags == y.stageFlags &&
+                    x.pImmutableSamplers == y.pImmutableSamplers
+                );
+            });
+        }
+
+        static bool same_writes(const std::vector<DescriptorWrite>& a, const std::vector<DescriptorWrite>& b) {
+            return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const auto& x, const auto& y) {
+                if (x.binding != y.binding || x.type != y.type) {
+                    return false;
+                }
+                if (x.is_image()) {
+                    return x.image.imageView == y.image.imageView && x.image.sampler == y.image.sampler;
+                }
+                return x.buffer.buffer == y.buffer.buffer && x.buffer.offset == y.buffer.offset && x.buffer.range == y.buffer.range;
+            });
+        }
+
+        VulkanDevice dev_;
+        DescriptorAllocator allocator_;
+        std::unordered_map<uint64_t, std::vector<LayoutEntry>> layouts_;
+        std::unordered_map<uint64_t, std::vector<SetEntry>> sets_;
+};
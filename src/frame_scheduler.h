@@ -0,0 +1,278 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "device.h"
+#include "utils.h"
+
+// Paces frames in flight with one timeline semaphore. Every submission
+// signals the next value of a single counter, so "has frame N finished" is
+// one comparison against the counter instead of a fence per frame slot, and
+// anything retired after a submission (uniform regions, descriptor pools,
+// old swapchains, texture slots) is safe to reuse once completed() reaches
+// that submission's serial. begin_frame() blocks until the oldest slot is
+// free again, try_begin_frame() returns instead of waiting. The binary
+// semaphores acquire and present still need are kept per slot.
+class FrameScheduler {
+    public:
+        static constexpr uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+
+        // VK_KHR_timeline_semaphore with the timelineSemaphore feature
+        static bool device_supports(VkPhysicalDevice dev) {
+            uint32_t ext_cnt = 0;
+            vkEnumerateDeviceExtensionProperties(dev, nullptr, &ext_cnt, nullptr);
+            auto exts = std::vector<VkExtensionProperties>(ext_cnt);
+            vkEnumerateDeviceExtensionProperties(dev, nullptr, &ext_cnt, exts.data());
+            auto has_ext = false;
+            for (const auto& ext : exts) {
+                has_ext = has_ext || std::strcmp(ext.extensionName, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) == 0;
+            }
+            if (!has_ext) {
+                return false;
+            }
+
+            auto timeline = VkPhysicalDeviceTimelineSemaphoreFeaturesKHR{};
+            timeline.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+            auto features = VkPhysicalDeviceFeatures2{};
+            features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            features.pNext = &timeline;
+            vkGetPhysicalDeviceFeatures2(dev, &features);
+            return timeline.timelineSemaphore == VK_TRUE;
+        }
+
+        // chain into VkDeviceCreateInfo::pNext of a device that passed device_supports()
+        static VkPhysicalDeviceTimelineSemaphoreFeaturesKHR required_features() noexcept {
+            auto ret = VkPhysicalDeviceTimelineSemaphoreFeaturesKHR{};
+            ret.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+            ret.timelineSemaphore = VK_TRUE;
+            return ret;
+        }
+
+        // `swapchain` creates the binary semaphores for acquire and present, headless frames go without
+        void init(VulkanDevice dev, uint32_t frames_in_flight, bool swapchain) {
+            dev_ = dev;
+            slot_ = 0;
+            submitted_ = 0;
+            completed_ = 0;
+            frame_serial_.assign(std::max(frames_in_flight, 1u), 0);
+
+            // the instance targets Vulkan 1.1, the timeline entry points come from the extension
+            get_counter_value_ = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(
+                vkGetDeviceProcAddr(dev_.logical, "vkGetSemaphoreCounterValueKHR")
+            );
+            wait_semaphores_ = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(
+                vkGetDeviceProcAddr(dev_.logical, "vkWaitSemaphoresKHR")
+            );
+
+            auto type_info = VkSemaphoreTypeCreateInfoKHR{};
+            type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+            type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+            type_info.initialValue = 0;
+            auto sema_info = VkSemaphoreCreateInfo{};
+            sema_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+            sema_info.pNext = &type_info;
+            if (auto res = vkCreateSemaphore(dev_.logical, &sema_info, nullptr, &timeline_); res != VK_SUCCESS) {
+                throw VulkanError("Error creating timeline Semaphore", res);
+            }
+
+            if (swapchain) {
+                image_available_.resize(frame_serial_.size());
+                render_finished_.resize(frame_serial_.size());
+                sema_info.pNext = nullptr;
+                for (size_t i=0; i<frame_serial_.size(); ++i) {
+                    if (auto res = vkCreateSemaphore(dev_.logical, &sema_info, nullptr, &image_available_[i]); res != VK_SUCCESS) {
+                        throw VulkanError("Error creating Semaphore", res);
+                    }
+                    if (auto res = vkCreateSemaphore(dev_.logical, &sema_info, nullptr, &render_finished_[i]); res != VK_SUCCESS) {
+                        throw VulkanError("Error creating Semaphore", res);
+                    }
+                }
+            }
+        }
+
+        // every submission must have completed
+        void destroy() {
+            for (auto sema : image_available_) {
+                vkDestroySemaphore(dev_.logical, sema, nullptr);
+            }
+            for (auto sema : render_finished_) {
+                vkDestroySemaphore(dev_.logical, sema, nullptr);
+            }
+            image_available_.clear();
+            render_finished_.clear();
+            vkDestroySemaphore(dev_.logical, timeline_, nullptr);
+            frame_serial_.clear();
+        }
+
+        uint32_t frames_in_flight() const noexcept {
+            return static_cast<uint32_t>(frame_serial_.size());
+        }
+
+        // slot of the frame being recorded, indexes per-frame resources
+        uint32_t frame() const noexcept {
+            return slot_;
+        }
+
+        // blocks until the current slot's previous frame has completed and returns the slot
+        uint32_t begin_frame() {
+            stall_ = std::chrono::steady_clock::duration::zero();
+            wait(frame_serial_[slot_]);
+            return slot_;
+        }
+
+        // the slot if its previous frame has completed, otherwise nothing and no wait
+        std::optional<uint32_t> try_begin_frame() {
+            if (!is_complete(frame_serial_[slot_])) {
+                return std::nullopt;
+            }
+            return begin_frame();
+        }
+
+        // moves on to the next slot, after the frame's submit() (and present) or if it was abandoned
+        void end_frame() noexcept {
+            slot_ = (slot_ + 1) % frames_in_flight();
+        }
+
+        // signaled by vkAcquireNextImageKHR for the current slot, only with a swapchain
+        VkSemaphore image_available() const noexcept {
+            return image_available_[slot_];
+        }
+
+        // waited on by vkQueuePresentKHR for the current slot, only with a swapchain
+        VkSemaphore render_finished() const noexcept {
+            return render_finished_[slot_];
+        }
+
+        // the serial the current frame signals once it is submitted
+        uint64_t next_serial() const noexcept {
+            return submitted_ + 1;
+        }
+
+        // submits the current frame, waiting for the acquired image and signaling presentation
+        // with a swapchain, and returns its serial
+        uint64_t submit(VkQueue queue, VkCommandBuffer cmd_buf) {
+            auto serial = next_serial();
+            auto swapchain = !image_available_.empty();
+
+            VkSemaphore wait_semas[] = {swapchain ? image_available_[slot_] : VK_NULL_HANDLE};
+            VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+            uint64_t wait_values[] = {0};
+            // binary semaphores ignore their value
+            VkSemaphore signal_semas[] = {timeline_, swapchain ? render_finished_[slot_] : VK_NULL_HANDLE};
+            uint64_t signal_values[] = {serial, 0};
+
+            auto timeline_info = VkTimelineSemaphoreSubmitInfoKHR{};
+            timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+            timeline_info.waitSemaphoreValueCount = swapchain ? 1 : 0;
+            timeline_info.pWaitSemaphoreValues = wait_values;
+            timeline_info.signalSemaphoreValueCount = swapchain ? 2 : 1;
+            timeline_info.pSignalSemaphoreValues = signal_values;
+
+            auto submit_info = VkSubmitInfo{};
+            submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submit_info.pNext = &timeline_info;
+            submit_info.waitSemaphoreCount = timeline_info.waitSemaphoreValueCount;
+            submit_info.pWaitSemaphores = wait_semas;
+            submit_info.pWaitDstStageMask = wait_stages;
+            submit_info.commandBufferCount = 1;
+            submit_info.pCommandBuffers = &cmd_buf;
+            submit_info.signalSemaphoreCount = timeline_info.signalSemaphoreValueCount;
+            submit_info.pSignalSemaphores = signal_semas;
+            if (auto res = vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE); res != VK_SUCCESS) {
+                throw VulkanError("Error submitting Queue", res);
+            }
+
+            submitted_ = serial;
+            frame_serial_[slot_] = serial;
+            return serial;
+        }
+
+        // serial of the last submitted frame, 0 before the first one
+        uint64_t submitted() const noexcept {
+            return submitted_;
+        }
+
+        // serial of the last frame the GPU has finished
+        uint64_t completed() {
+            if (completed_ < submitted_) {
+                uint64_t value = 0;
+                if (auto res = get_counter_value_(dev_.logical, timeline_, &value); res != VK_SUCCESS) {
+                    throw VulkanError("Error reading timeline Semaphore", res);
+                }
+                completed_ = std::max(completed_, value);
+            }
+            return completed_;
+        }
+
+        bool is_complete(uint64_t serial) {
+            return serial <= completed_ || serial <= completed();
+        }
+
+        // blocks until the frame with `serial` has completed, the time spent counts as stall
+        void wait(uint64_t serial) {
+            if (is_complete(serial)) {
+                return;
+            }
+            auto start = std::chrono::steady_clock::now();
+            auto wait_info = VkSemaphoreWaitInfoKHR{};
+            wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+            wait_info.semaphoreCount = 1;
+            wait_info.pSemaphores = &timeline_;
+            wait_info.pValues = &serial;
+            if (auto res = wait_semaphores_(dev_.logical, &wait_info, UINT64_MAX); res != VK_SUCCESS) {
+                throw VulkanError("Error waiting for timeline Semaphore", res);
+            }
+            completed_ = std::max(completed_, serial);
+            stall_ += std::chrono::steady_clock::now() - start;
+        }
+
+        // waits for the frame with `serial` no longer than `deadline`, whether it completed; not a stall,
+        // for time the CPU would otherwise sleep
+        bool wait_until(uint64_t serial, std::chrono::steady_clock::time_point deadline) {
+            if (is_complete(serial)) {
+                return true;
+            }
+            auto left = std::max(deadline - std::chrono::steady_clock::now(), std::chrono::steady_clock::duration::zero());
+            auto timeout = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(left).count());
+            auto wait_info = VkSemaphoreWaitInfoKHR{};
+            wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+            wait_info.semaphoreCount = 1;
+            wait_info.pSemaphores = &timeline_;
+            wait_info.pValues = &serial;
+            auto res = wait_semaphores_(dev_.logical, &wait_info, timeout);
+            if (res == VK_TIMEOUT) {
+                return false;
+            }
+            if (res != VK_SUCCESS) {
+                throw VulkanError("Error waiting for timeline Semaphore", res);
+            }
+            completed_ = std::max(completed_, serial);
+            return true;
+        }
+
+        // CPU time the current frame has spent blocked on the GPU since begin_frame()
+        double stall_ms() const noexcept {
+            return std::chrono::duration<double, std::milli>(stall_).count();
+        }
+
+    private:
+        VulkanDevice dev_;
+        VkSemaphore timeline_ = VK_NULL_HANDLE;
+        PFN_vkGetSemaphoreCounterValueKHR get_counter_value_ = nullptr;
+        PFN_vkWaitSemaphoresKHR wait_semaphores_ = nullptr;
+        std::vector<VkSemaphore> image_available_;
+        std::vector<VkSemaphore> render_finished_;
+        // serial each slot signaled last, 0 if it was never submitted
+        std::vector<uint64_t> frame_serial_;
+        uint32_t slot_ = 0;
+        uint64_t submitted_ = 0;
+        uint64_t completed_ = 0;
+        std::chrono::steady_clock::duration stall_ = std::chrono::steady_clock::duration::zero();
+};
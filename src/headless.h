@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include <vulkan/vulkan.h>
+
+#include "allocator.h"
+#include "buffer.h"
+#include "device.h"
+#include "texture.h"
+#include "utils.h"
+
+// A finished frame read back into host memory, tightly packed RGBA8 (sRGB).
+// `pixels` is only valid for the duration of the callback.
+struct FrameImage {
+    uint64_t index;
+    uint32_t width;
+    uint32_t height;
+    const uint8_t* pixels;
+};
+
+using FrameCallback = std::function<void(const FrameImage&)>;
+
+inline void write_ppm(const std::filesystem::path& fpath, const FrameImage& frame) {
+    auto ofs = std::ofstream(fpath, std::ios::binary);
+    if (!ofs) {
+        throw std::runtime_error("Error opening " + fpath.string());
+    }
+    ofs << "P6\n" << frame.width << " " << frame.height << "\n255\n";
+    auto row = std::vector<char>(frame.width * 3);
+    for (uint32_t y=0; y<frame.height; ++y) {
+        auto src = frame.pixels + size_t{y} * frame.width * 4;
+        for (uint32_t x=0; x<frame.width; ++x) {
+            row[x*3 + 0] = static_cast<char>(src[x*4 + 0]);
+            row[x*3 + 1] = static_cast<char>(src[x*4 + 1]);
+            row[x*3 + 2] = static_cast<char>(src[x*4 + 2]);
+        }
+        ofs.write(row.data(), static_cast<std::streamsize>(row.size()));
+    }
+}
+
+inline void write_png(const std::filesystem::path& fpath, const FrameImage& frame) {
+    auto stride = static_cast<int>(frame.width * 4);
+    if (stbi_write_png(fpath.c_str(), static_cast<int>(frame.width), static_cast<int>(frame.height), 4, frame.pixels, stride) == 0) {
+        throw std::runtime_error("Error writing " + fpath.string());
+    }
+}
+
+// Stands in for the swapchain when there is no surface. Owns a set of color
+// images the renderer draws into and one host-visible buffer per image that
+// receives a copy of the finished frame; record_readback() appends the copy
+// to the frame's command buffer and collect() hands the pixels to the
+// callback once the frame's fence has signaled.
+class OffscreenTarget {
+    public:
+        static constexpr VkFormat FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+
+        void init(VulkanDevice dev, DeviceAllocator& allocator, VkExtent2D extent, uint32_t img_cnt) {
+            dev_ = dev;
+            extent_ = extent;
+            images_.resize(img_cnt);
+
+            auto img_desc = ImageDesc{};
+            img_desc.width = extent.width;
+            img_desc.height = extent.height;
+            img_desc.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            img_desc.mem_props = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+            auto buf_desc = BufferDesc{};
+            buf_desc.size = frame_size();
+            buf_desc.buf_usage_flags = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+            buf_desc.mem_prop_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+            for (auto& img : images_) {
+                create_image(dev_, allocator, img_desc, &img.image, &img.image_mem);
+                create_buffer(dev_, allocator, buf_desc, &img.readback, &img.readback_mem);
+            }
+        }
+
+        void destroy(DeviceAllocator& allocator) {
+            for (auto& img : images_) {
+                destroy_buffer(dev_, allocator, img.readback, img.readback_mem);
+                destroy_image(dev_, allocator, img.image, img.image_mem);
+            }
+            images_.clear();
+        }
+
+        void set_callback(FrameCallback callback) {
+            callback_ = std::move(callback);
+        }
+
+        VkExtent2D extent() const noexcept {
+            return extent_;
+        }
+
+        std::vector<VkImage> images() const {
+            auto ret = std::vector<VkImage>{};
+            for (const auto& img : images_) {
+                ret.push_back(img.image);
+            }
+            return ret;
+        }
+
+        // images are used round-robin, the caller waits for the previous use of the returned image
+        uint32_t next_image() noexcept {
+            auto ret = next_;
+            next_ = (next_ + 1) % static_cast<uint32_t>(images_.size());
+            return ret;
+        }
+
+        // expects the image in TRANSFER_SRC_OPTIMAL, i.e. the render pass' final layout, and the
+        // pass' outgoing dependency to make its color writes visible to transfer reads
+        void record_readback(VkCommandBuffer cmd_buf, uint32_t img_idx) const {
+            const auto& img = images_[img_idx];
+
+            auto region = VkBufferImageCopy{};
+            region.bufferOffset = 0;
+            region.bufferRowLength = 0;
+            region.bufferImageHeight = 0;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = 0;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset = VkOffset3D{0, 0, 0};
+            region.imageExtent = VkExtent3D{extent_.width, extent_.height, 1};
+            vkCmdCopyImageToBuffer(cmd_buf, img.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, img.readback, 1, &region);
+
+            auto barrier = VkBufferMemoryBarrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.buffer = img.readback;
+            barrier.offset = 0;
+            barrier.size = VK_WHOLE_SIZE;
+            vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                0, nullptr,
+                1, &barrier,
+                0, nullptr
+            );
+        }
+
+        // the frame rendering into `img_idx` has been submitted
+        void mark_pending(uint32_t img_idx) {
+            images_[img_idx].pending = true;
+            images_[img_idx].frame = frame_cnt_++;
+        }
+
+        // call only once the fence of the frame that rendered `img_idx` has signaled
+        void collect(uint32_t img_idx) {
+            auto& img = images_[img_idx];
+            if (!img.pending) {
+                return;
+            }
+            img.pending = false;
+            if (!callback_) {
+                return;
+            }
+
+            auto frame = FrameImage{};
+            frame.index = img.frame;
+            frame.width = extent_.width;
+            frame.height = extent_.height;
+            frame.pixels = static_cast<const uint8_t*>(img.readback_mem.mapped);
+            callback_(frame);
+        }
+
+        // after the device is idle, delivers every outstanding frame in submission order
+        void collect_all() {
+            auto order = std::vector<uint32_t>{};
+            for (uint32_t i=0; i<images_.size(); ++i) {
+                if (images_[i].pending) {
+                    order.push_back(i);
+                }
+            }
+            std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+                return images_[a].frame < images_[b].frame;
+            });
+            for (auto idx : order) {
+                collect(idx);
+            }
+        }
+
+    private:
+        struct Image {
+            VkImage image;
+            Allocation image_mem;
+            VkBuffer readback;
+            Allocation readback_mem;
+            uint64_t frame = 0;
+            bool pending = false;
+        };
+
+        VkDeviceSize frame_size() const noexcept {
+            return VkDeviceSize{extent_.width} * extent_.height * 4;
+        }
+
+        VulkanDevice dev_;
+        VkExtent2D extent_;
+        std::vector<Image> images_;
+        uint32_t next_ = 0;
+        uint64_t frame_cnt_ = 0;
+        FrameCallback callback_;
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that run one job per worker at a time. run()
+// hands the same callable to every worker, each is told its index so it
+// picks its own partition of the work and its own per-worker resources.
+// The calling thread acts as worker 0, so a system of one worker starts no
+// threads at all.
+class JobSystem {
+    public:
+        using Job = std::function<void(uint32_t worker)>;
+
+        void init(uint32_t worker_cnt) {
+            worker_cnt_ = std::max(worker_cnt, 1u);
+            stop_ = false;
+            for (uint32_t i=1; i<worker_cnt_; ++i) {
+                threads_.emplace_back([this, i]() { worker_main(i); });
+            }
+        }
+
+        void destroy() {
+            {
+                auto lock = std::lock_guard(mutex_);
+                stop_ = true;
+            }
+            start_cv_.notify_all();
+            for (auto& thread : threads_) {
+                thread.join();
+            }
+            threads_.clear();
+        }
+
+        uint32_t worker_count() const noexcept {
+            return worker_cnt_;
+        }
+
+        // blocks until `job` has returned on every worker, rethrows the first exception
+        void run(const Job& job) {
+            {
+                auto lock = std::lock_guard(mutex_);
+                job_ = &job;
+                pending_ = worker_cnt_ - 1;
+                error_ = nullptr;
+                ++generation_;
+            }
+            start_cv_.notify_all();
+
+            execute(job, 0);
+
+            auto lock = std::unique_lock(mutex_);
+            done_cv_.wait(lock, [this]() { return pending_ == 0; });
+            job_ = nullptr;
+            if (error_) {
+                std::rethrow_exception(error_);
+            }
+        }
+
+    private:
+        void worker_main(uint32_t idx) {
+            auto seen = uint64_t{0};
+            while (true) {
+                const Job* job;
+                {
+                    auto lock = std::unique_lock(mutex_);
+                    start_cv_.wait(lock, [this, seen]() { return stop_ || generation_ != seen; });
+                    if (stop_) {
+                        return;
+                    }
+                    seen = generation_;
+                    job = job_;
+                }
+
+                execute(*job, idx);
+
+                {
+                    auto lock = std::lock_guard(mutex_);
+                    --pending_;
+                }
+                done_cv_.notify_one();
+            }
+        }
+
+        void execute(const Job& job, uint32_t idx) {
+            try {
+                job(idx);
+            }
+            catch (...) {
+                auto lock = std::lock_guard(mutex_);
+                if (!error_) {
+                    error_ = std::current_exception();
+                }
+            }
+        }
+
+        uint32_t worker_cnt_ = 1;
+        std::vector<std::thread> threads_;
+        std::mutex mutex_;
+        std::condition_variable start_cv_;
+        std::condition_variable done_cv_;
+        const Job* job_ = nullptr;
+        uint64_t generation_ = 0;
+        uint32_t pending_ = 0;
+        bool stop_ = false;
+        std::exception_ptr error_;
+};
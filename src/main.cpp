@@ -1,6 +1,9 @@
+#include <cstdio>
 #include <filesystem>
 #include <iostream>
 #include <memory>
+#include <string>
+#include <string_view>
 
 #include <unistd.h>
 
@@ -9,11 +12,131 @@
 
 #include "renderer.h"
 
+struct CmdArgs {
+    bool headless = false;
+    bool gpu_report = false;
+    uint32_t threads = 1;
+    PresentPolicy present = PresentPolicy::power_saving;
+    double fps_limit = 0.0;
+    std::filesystem::path mesh;
+    uint32_t frames = 1;
+    uint32_t width = 800;
+    uint32_t height = 600;
+    std::filesystem::path out_dir = ".";
+    std::string format = "png";
+};
+
+// [--gpu-report] [--threads N] [--present low-latency|power-saving] [--fps-limit FPS] [--mesh FILE] [--headless [--frames N] [--size WxH] [--out DIR] [--format png|ppm]]
+CmdArgs parse_args(int argc, char* argv[]) {
+    auto ret = CmdArgs{};
+    for (int i=1; i<argc; ++i) {
+        auto arg = std::string_view(argv[i]);
+        auto has_value = (i+1 < argc);
+        if (arg == "--headless") {
+            ret.headless = true;
+        } else if (arg == "--gpu-report") {
+            ret.gpu_report = true;
+        } else if (arg == "--threads" && has_value) {
+            ret.threads = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--present" && has_value) {
+            auto policy = std::string_view(argv[++i]);
+            if (policy == "low-latency") {
+                ret.present = PresentPolicy::low_latency;
+            } else if (policy == "power-saving") {
+                ret.present = PresentPolicy::power_saving;
+            } else {
+                throw std::runtime_error("--present must be low-latency or power-saving");
+            }
+        } else if (arg == "--fps-limit" && has_value) {
+            ret.fps_limit = std::stod(argv[++i]);
+        } else if (arg == "--mesh" && has_value) {
+            ret.mesh = argv[++i];
+        } else if (arg == "--frames" && has_value) {
+            ret.frames = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--size" && has_value) {
+            if (std::sscanf(argv[++i], "%ux%u", &ret.width, &ret.height) != 2) {
+                throw std::runtime_error("--size expects WIDTHxHEIGHT");
+            }
+        } else if (arg == "--out" && has_value) {
+            ret.out_dir = argv[++i];
+        } else if (arg == "--format" && has_value) {
+            ret.format = argv[++i];
+        } else {
+            throw std::runtime_error("unknown argument " + std::string(arg));
+        }
+    }
+    if (ret.format != "png" && ret.format != "ppm") {
+        throw std::runtime_error("--format must be png or ppm");
+    }
+    ret.out_dir = std::filesystem::absolute(ret.out_dir);
+    if (!ret.mesh.empty()) {
+        ret.mesh = std::filesystem::absolute(ret.mesh);
+    }
+    return ret;
+}
+
+// the default scene, drawing the given mesh instead of the quad
+SceneDesc scene_desc(const CmdArgs& args) {
+    auto ret = SceneDesc{};
+    ret.mesh = args.mesh;
+    return ret;
+}
+
+int run_headless(const CmdArgs& args) {
+    std::filesystem::create_directories(args.out_dir);
+
+    auto renderer = VulkanRenderer(VkExtent2D{args.width, args.height});
+    renderer.set_profiler_report(args.gpu_report);
+    renderer.set_record_threads(args.threads);
+    renderer.set_scene(scene_desc(args));
+    renderer.set_frame_callback([&args](const FrameImage& frame) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "frame_%05llu.%s", static_cast<unsigned long long>(frame.index), args.format.c_str());
+        if (args.format == "png") {
+            write_png(args.out_dir / name, frame);
+        } else {
+            write_ppm(args.out_dir / name, frame);
+        }
+    });
+
+    try {
+        renderer.init();
+        // frames are compared across runs, none of them may show the placeholder
+        renderer.wait_for_textures();
+        for (uint32_t i=0; i<args.frames; ++i) {
+            renderer.draw_frame();
+        }
+        renderer.destroy();
+    }
+    catch (const VulkanError& ex) {
+        std::cerr << ex.what() << std::endl;
+        std::cerr << "Errorcode: " << ex.get_error() << std::endl;
+        return 1;
+    }
+    catch (const std::exception& ex) {
+        std::cerr << "Unhandled exception: " << ex.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
 
 int main(int argc, char* argv[]) {
+    auto args = CmdArgs{};
+    try {
+        args = parse_args(argc, argv);
+    }
+    catch (const std::exception& ex) {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+
     std::cout << std::filesystem::path(argv[0]).remove_filename() << std::endl;
     chdir(std::filesystem::path(argv[0]).remove_filename().c_str());
 
+    if (args.headless) {
+        return run_headless(args);
+    }
+
     std::cout << "GLFW: " << glfwGetVersionString() << std::endl;
 
     // initialize GLFW
@@ -42,11 +165,18 @@ int main(int argc, char* argv[]) {
     }
 
     auto renderer = VulkanRenderer(win);
+    renderer.set_profiler_report(args.gpu_report);
+    renderer.set_record_threads(args.threads);
+    renderer.set_scene(scene_desc(args));
+    renderer.set_present_policy(args.present);
+    renderer.set_frame_limit(args.fps_limit);
     try {
         renderer.init();
         glfwSetWindowUserPointer(win, reinterpret_cast<void*>(&renderer));
 
         while (!glfwWindowShouldClose(win)) {
+            // wait before polling, so the frame is drawn from the freshest input
+            renderer.pace_frame();
             glfwPollEvents();
             renderer.draw_frame();
         }
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only mapping of a whole file. Assets are parsed and copied into
+// staging memory straight out of the page cache, so loading allocates
+// nothing the size of the file and pages that were consumed can be handed
+// back with release() instead of staying resident until the asset dies.
+class MappedFile {
+    public:
+        // how the mapping is going to be read, passed on to madvise
+        enum class Access {
+            sequential, // read once front to back, the kernel reads ahead aggressively
+            random,     // sparse lookups, no read-ahead
+            whole,      // small files needed in full right away, prefetched at map time
+        };
+
+        MappedFile() = default;
+
+        explicit MappedFile(const std::filesystem::path& fpath, Access access = Access::sequential) {
+            auto fd = ::open(fpath.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                throw std::runtime_error("Error opening " + fpath.string());
+            }
+            struct stat st;
+            if (::fstat(fd, &st) != 0) {
+                ::close(fd);
+                throw std::runtime_error("Error reading size of " + fpath.string());
+            }
+            size_ = static_cast<size_t>(st.st_size);
+
+            // mmap rejects empty mappings, an empty file is an empty span
+            if (size_ > 0) {
+                auto addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr == MAP_FAILED) {
+                    ::close(fd);
+                    throw std::runtime_error("Error mapping " + fpath.string());
+                }
+                data_ = static_cast<const uint8_t*>(addr);
+                advise(0, size_, access);
+            }
+            // the mapping keeps its own reference to the file
+            ::close(fd);
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        MappedFile(MappedFile&& other) noexcept :
+            data_(std::exchange(other.data_, nullptr)),
+            size_(std::exchange(other.size_, 0)) {}
+
+        MappedFile& operator=(MappedFile&& other) noexcept {
+            if (this != &other) {
+                unmap();
+                data_ = std::exchange(other.data_, nullptr);
+                size_ = std::exchange(other.size_, 0);
+            }
+            return *this;
+        }
+
+        ~MappedFile() {
+            unmap();
+        }
+
+        std::span<const uint8_t> bytes() const noexcept {
+            return {data_, size_};
+        }
+
+        const uint8_t* data() const noexcept {
+            return data_;
+        }
+
+        size_t size() const noexcept {
+            return size_;
+        }
+
+        // hints are best effort, a kernel that ignores them changes nothing but speed
+        void advise(size_t offset, size_t size, Access access) const noexcept {
+            auto [begin, len] = page_range(offset, size, false);
+            if (len == 0) {
+                return;
+            }
+            switch (access) {
+                case Access::sequential:
+                    ::madvise(begin, len, MADV_SEQUENTIAL);
+                    break;
+                case Access::random:
+                    ::madvise(begin, len, MADV_RANDOM);
+                    break;
+                case Access::whole:
+                    ::madvise(begin, len, MADV_WILLNEED);
+                    break;
+            }
+        }
+
+        // drops the pages fully inside the range from this process, the data stays readable
+        // and is faulted back in from the page cache or the file if touched again
+        void release(size_t offset, size_t size) const noexcept {
+            auto [begin, len] = page_range(offset, size, true);
+            if (len > 0) {
+                ::madvise(begin, len, MADV_DONTNEED);
+            }
+        }
+
+    private:
+        // page aligned cover of the range, or only the pages it fully contains if `inner`
+        std::pair<void*, size_t> page_range(size_t offset, size_t size, bool inner) const noexcept {
+            if (data_ == nullptr || offset >= size_) {
+                return {nullptr, 0};
+            }
+            auto page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+            auto end = std::min(offset + size, size_);
+            auto first = inner ? (offset + page - 1) / page * page : offset / page * page;
+            // the tail page of the file counts as full, nothing else lives in it
+            auto last = (inner && end != size_) ? end / page * page : (end + page - 1) / page * page;
+            if (last <= first) {
+                return {nullptr, 0};
+            }
+            return {const_cast<uint8_t*>(data_) + first, last - first};
+        }
+
+        void unmap() noexcept {
+            if (data_ != nullptr) {
+                ::munmap(const_cast<uint8_t*>(data_), size_);
+                data_ = nullptr;
+                size_ = 0;
+            }
+        }
+
+        const uint8_t* data_ = nullptr;
+        size_t size_ = 0;
+};
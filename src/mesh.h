@@ -0,0 +1,207 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+
+#include "buffer.h"
+#include "mapped_file.h"
+
+// Geometry in the layout the renderer draws it, written by mesh_cooker:
+//
+//   MeshHeader | vertices (Vertex or PackedVertex[vertex_count]) | indices (uint16 or uint32)
+//
+// Both blobs start on a BLOB_ALIGNMENT boundary, so a mapped file hands out
+// arrays that are copied into staging memory as they are, nothing is parsed
+// or converted at load time. Indices are 16 bit whenever every vertex is
+// reachable with them and 32 bit beyond 65536 vertices, vertices are in
+// the header's VertexFormat and the pipeline's input layout follows it.
+struct MeshHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t vertex_count;
+    uint32_t vertex_stride;
+    uint32_t index_count;
+    uint32_t index_size;
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    // sphere around the origin enclosing every vertex, for culling
+    float radius;
+    VertexFormat vertex_format;
+    uint32_t reserved[4];
+};
+static_assert(sizeof(MeshHeader) == 64, "MeshHeader is part of the file format");
+
+class Mesh {
+    public:
+        static constexpr char MAGIC[4] = {'V', 'K', 'M', 'S'};
+        static constexpr uint32_t VERSION = 2;
+        static constexpr uint64_t BLOB_ALIGNMENT = 64;
+
+        Mesh() = default;
+
+        // validates the header against the file, the blobs are read straight from the mapping
+        static Mesh load(const std::filesystem::path& fpath) {
+            auto ret = Mesh{};
+            ret.file_ = MappedFile(fpath, MappedFile::Access::sequential);
+            ret.parse(ret.file_.bytes(), fpath.string());
+            return ret;
+        }
+
+        // packs geometry into the file layout in memory, indices narrowed to 16 bit where they fit;
+        // VertexFormat::packed needs every vertex to fit PackedVertex
+        static Mesh pack(
+            const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+            VertexFormat format = VertexFormat::full
+        ) {
+            if (format == VertexFormat::packed && !std::all_of(vertices.begin(), vertices.end(), PackedVertex::fits)) {
+                throw std::runtime_error("Mesh has vertices out of range for the packed format");
+            }
+
+            auto header = MeshHeader{};
+            std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+            header.version = VERSION;
+            header.vertex_count = static_cast<uint32_t>(vertices.size());
+            header.vertex_stride = vertex_stride(format);
+            header.vertex_format = format;
+            header.index_count = static_cast<uint32_t>(indices.size());
+            header.index_size = (vertices.size() <= 0x10000) ? 2 : 4;
+            header.vertex_offset = align(sizeof(MeshHeader));
+            header.index_offset = align(header.vertex_offset + uint64_t{header.vertex_count} * header.vertex_stride);
+            for (const auto& vert : vertices) {
+                header.radius = std::max(header.radius, glm::length(vert.pos));
+            }
+            if (format == VertexFormat::packed) {
+                // half floats round to within 2^-11 of the value
+                header.radius *= 1.0f + 1.0f / 1024.0f;
+            }
+
+            auto ret = Mesh{};
+            ret.owned_.resize(header.index_offset + uint64_t{header.index_count} * header.index_size);
+            std::memcpy(ret.owned_.data(), &header, sizeof(header));
+            if (format == VertexFormat::packed) {
+                for (size_t i=0; i<vertices.size(); ++i) {
+                    auto packed = PackedVertex::pack(vertices[i]);
+                    std::memcpy(ret.owned_.data() + header.vertex_offset + i * sizeof(packed), &packed, sizeof(packed));
+                }
+            } else {
+                std::memcpy(ret.owned_.data() + header.vertex_offset, vertices.data(), vertices.size() * sizeof(Vertex));
+            }
+            auto dst = ret.owned_.data() + header.index_offset;
+            if (header.index_size == 2) {
+                for (size_t i=0; i<indices.size(); ++i) {
+                    auto idx = static_cast<uint16_t>(indices[i]);
+                    std::memcpy(dst + i * sizeof(idx), &idx, sizeof(idx));
+                }
+            } else {
+                std::memcpy(dst, indices.data(), indices.size() * sizeof(uint32_t));
+            }
+            ret.parse(ret.owned_, "packed mesh");
+            return ret;
+        }
+
+        // the unit quad the renderer draws without a mesh file
+        static Mesh quad() {
+            return pack(
+                {
+                    Vertex{{-0.5f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}, {1.0f, 0.0f}},
+                    Vertex{{0.5f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
+                    Vertex{{0.5f, 0.5f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 1.0f}},
+                    Vertex{{-0.5f, 0.5f, 0.0f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}},
+                },
+                {0, 1, 2, 2, 3, 0}
+            );
+        }
+
+        void save(const std::filesystem::path& fpath) const {
+            auto out = std::ofstream(fpath, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(bytes_.data()), static_cast<std::streamsize>(bytes_.size()));
+            if (!out) {
+                throw std::runtime_error("Error writing " + fpath.string());
+            }
+        }
+
+        uint32_t vertex_count() const noexcept {
+            return header_.vertex_count;
+        }
+
+        uint32_t index_count() const noexcept {
+            return header_.index_count;
+        }
+
+        VertexFormat vertex_format() const noexcept {
+            return header_.vertex_format;
+        }
+
+        VkIndexType index_type() const noexcept {
+            return (header_.index_size == 2) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+        }
+
+        float radius() const noexcept {
+            return header_.radius;
+        }
+
+        std::span<const uint8_t> vertex_bytes() const noexcept {
+            return bytes_.subspan(header_.vertex_offset, size_t{header_.vertex_count} * header_.vertex_stride);
+        }
+
+        std::span<const uint8_t> index_bytes() const noexcept {
+            return bytes_.subspan(header_.index_offset, size_t{header_.index_count} * header_.index_size);
+        }
+
+        // the whole file image, header included
+        std::span<const uint8_t> bytes() const noexcept {
+            return bytes_;
+        }
+
+    private:
+        static uint64_t align(uint64_t offset) noexcept {
+            return (offset + BLOB_ALIGNMENT - 1) / BLOB_ALIGNMENT * BLOB_ALIGNMENT;
+        }
+
+        void parse(std::span<const uint8_t> bytes, const std::string& name) {
+            if (bytes.size() < sizeof(MeshHeader)) {
+                throw std::runtime_error(name + " is too small for a mesh");
+            }
+            std::memcpy(&header_, bytes.data(), sizeof(header_));
+            if (std::memcmp(header_.magic, MAGIC, sizeof(MAGIC)) != 0 || header_.version != VERSION) {
+                throw std::runtime_error(name + " is not a version " + std::to_string(VERSION) + " mesh");
+            }
+            if (
+                (header_.vertex_format != VertexFormat::full && header_.vertex_format != VertexFormat::packed) ||
+                header_.vertex_stride != vertex_stride(header_.vertex_format)
+            ) {
+                throw std::runtime_error(name + " was cooked for a different vertex layout");
+            }
+            if (header_.vertex_count == 0 || header_.index_count == 0) {
+                throw std::runtime_error(name + " has no geometry");
+            }
+            if (header_.index_size != 2 && header_.index_size != 4) {
+                throw std::runtime_error(name + " has an invalid index size");
+            }
+            auto vertex_end = header_.vertex_offset + uint64_t{header_.vertex_count} * header_.vertex_stride;
+            auto index_end = header_.index_offset + uint64_t{header_.index_count} * header_.index_size;
+            if (
+                header_.vertex_offset % BLOB_ALIGNMENT != 0 || header_.index_offset % BLOB_ALIGNMENT != 0 ||
+                vertex_end > bytes.size() || index_end > bytes.size()
+            ) {
+                throw std::runtime_error(name + " is truncated or misaligned");
+            }
+            bytes_ = bytes;
+        }
+
+        MeshHeader header_{};
+        // one of them backs bytes_
+        MappedFile file_;
+        std::vector<uint8_t> owned_;
+        std::span<const uint8_t> bytes_;
+};
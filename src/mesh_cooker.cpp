@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "mapped_file.h"
+#include "mesh.h"
+#include "mesh_optimizer.h"
+
+// Offline mesh cooker: converts a Wavefront OBJ into the binary mesh format
+// the renderer maps and uploads as is, e.g. `mesh_cooker model.obj model.mesh`.
+// Polygons are fanned into triangles, corners sharing a position, texture
+// coordinate and color are merged into one vertex, and OBJ's bottom-up
+// texture coordinates are flipped to Vulkan's top-down ones. Triangles are
+// then reordered for the post-transform cache and vertices for fetch
+// locality unless `--no-optimize` is given. `--vertex` picks the vertex
+// format, auto packs only when every vertex fits PackedVertex and half-float
+// positions stay within PACKED_POSITION_TOLERANCE of the mesh's extent.
+
+// half floats keep 11 significant bits, a mesh modeled far from its origin
+// fits the range but snaps to a grid that is coarse against its size
+constexpr float PACKED_POSITION_TOLERANCE = 1.0f / 1024.0f;
+
+struct ObjData {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> colors;
+    std::vector<glm::vec2> uvs;
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
+std::string_view next_token(std::string_view& line) {
+    auto begin = line.find_first_not_of(" \t\r");
+    if (begin == std::string_view::npos) {
+        line = {};
+        return {};
+    }
+    line.remove_prefix(begin);
+    auto end = std::min(line.find_first_of(" \t\r"), line.size());
+    auto ret = line.substr(0, end);
+    line.remove_prefix(end);
+    return ret;
+}
+
+float parse_float(std::string_view token) {
+    auto ret = 0.0f;
+    auto [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), ret);
+    if (ec != std::errc{}) {
+        throw std::runtime_error("invalid number " + std::string(token));
+    }
+    return ret;
+}
+
+// 1-based, negative counts back from the last element read so far, 0 means absent
+uint32_t resolve_index(std::string_view token, size_t count) {
+    if (token.empty()) {
+        return 0;
+    }
+    auto idx = int64_t{0};
+    auto [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), idx);
+    if (ec != std::errc{} || idx == 0) {
+        throw std::runtime_error("invalid index " + std::string(token));
+    }
+    auto ret = (idx < 0) ? static_cast<int64_t>(count) + idx + 1 : idx;
+    if (ret < 1 || ret > static_cast<int64_t>(count)) {
+        throw std::runtime_error("index out of range " + std::string(token));
+    }
+    return static_cast<uint32_t>(ret);
+}
+
+struct CornerKey {
+    uint32_t position;
+    uint32_t uv;
+
+    bool operator==(const CornerKey&) const = default;
+};
+
+struct CornerHash {
+    size_t operator()(const CornerKey& key) const noexcept {
+        return std::hash<uint64_t>{}((uint64_t{key.position} << 32) | key.uv);
+    }
+};
+
+ObjData parse_obj(std::span<const uint8_t> bytes) {
+    auto ret = ObjData{};
+    auto corners = std::unordered_map<CornerKey, uint32_t, CornerHash>{};
+    auto face = std::vector<uint32_t>{};
+    auto text = std::string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+
+    size_t line_no = 0;
+    while (!text.empty()) {
+        auto eol = std::min(text.find('\n'), text.size());
+        auto line = text.substr(0, eol);
+        text.remove_prefix(std::min(eol + 1, text.size()));
+        ++line_no;
+
+        try {
+            auto kind = next_token(line);
+            if (kind == "v") {
+                // "x y z", "x y z w" with w ignored, or the common "x y z r g b" extension
+                auto values = std::vector<float>{};
+                for (auto token = next_token(line); !token.empty(); token = next_token(line)) {
+                    values.push_back(parse_float(token));
+                }
+                if (values.size() != 3 && values.size() != 4 && values.size() != 6) {
+                    throw std::runtime_error("vertex needs 3, 4 or 6 values, not " + std::to_string(values.size()));
+                }
+                auto pos = glm::vec3(values[0], values[1], values[2]);
+                auto color = glm::vec3(1.0f);
+                if (values.size() == 6) {
+                    color = glm::vec3(values[3], values[4], values[5]);
+                }
+                ret.positions.push_back(pos);
+                ret.colors.push_back(color);
+            } else if (kind == "vt") {
+                auto u = parse_float(next_token(line));
+                auto v = parse_float(next_token(line));
+                ret.uvs.push_back(glm::vec2(u, 1.0f - v));
+            } else if (kind == "f") {
+                face.clear();
+                for (auto corner = next_token(line); !corner.empty(); corner = next_token(line)) {
+                    // v, v/vt, v//vn or v/vt/vn, normals are not part of the vertex layout
+                    auto slash = std::min(corner.find('/'), corner.size());
+                    auto key = CornerKey{};
+                    key.position = resolve_index(corner.substr(0, slash), ret.positions.size());
+                    if (slash < corner.size()) {
+                        auto rest = corner.substr(slash + 1);
+                        key.uv = resolve_index(rest.substr(0, std::min(rest.find('/'), rest.size())), ret.uvs.size());
+                    }
+                    if (key.position == 0) {
+                        throw std::runtime_error("face corner without a position");
+                    }
+
+                    auto [it, inserted] = corners.try_emplace(key, static_cast<uint32_t>(ret.vertices.size()));
+                    if (inserted) {
+                        auto vert = Vertex{};
+                        vert.pos = ret.positions[key.position - 1];
+                        vert.color = ret.colors[key.position - 1];
+                        vert.uv = (key.uv > 0) ? ret.uvs[key.uv - 1] : glm::vec2(0.0f);
+                        ret.vertices.push_back(vert);
+                    }
+                    face.push_back(it->second);
+                }
+                for (size_t i=2; i<face.size(); ++i) {
+                    ret.indices.insert(ret.indices.end(), {face[0], face[i-1], face[i]});
+                }
+            }
+            // groups, objects, materials, normals and smoothing are ignored
+        }
+        catch (const std::exception& ex) {
+            throw std::runtime_error("line " + std::to_string(line_no) + ": " + ex.what());
+        }
+    }
+    return ret;
+}
+
+bool packs_precisely(const std::vector<Vertex>& vertices) {
+    if (!std::all_of(vertices.begin(), vertices.end(), PackedVertex::fits)) {
+        return false;
+    }
+    // the mesh's own size, the radius around the origin would grow with the offset
+    auto lo = vertices.front().pos;
+    auto hi = vertices.front().pos;
+    auto max_error = 0.0f;
+    for (const auto& vert : vertices) {
+        auto packed = glm::vec3(glm::unpackHalf4x16(glm::packHalf4x16(glm::vec4(vert.pos, 1.0f))));
+        max_error = std::max(max_error, glm::distance(packed, vert.pos));
+        for (int i=0; i<3; ++i) {
+            lo[i] = std::min(lo[i], vert.pos[i]);
+            hi[i] = std::max(hi[i], vert.pos[i]);
+        }
+    }
+    return max_error <= 0.5f * glm::distance(lo, hi) * PACKED_POSITION_TOLERANCE;
+}
+
+int main(int argc, char* argv[]) {
+    auto paths = std::vector<std::filesystem::path>{};
+    auto optimize = true;
+    auto vertex = std::string("auto");
+    for (int i=1; i<argc; ++i) {
+        auto arg = std::string_view(argv[i]);
+        if (arg == "--no-optimize") {
+            optimize = false;
+        } else if (arg == "--vertex" && i+1 < argc) {
+            vertex = argv[++i];
+        } else {
+            paths.emplace_back(arg);
+        }
+    }
+    if (paths.size() != 2 || (vertex != "auto" && vertex != "full" && vertex != "packed")) {
+        std::cerr << "usage: mesh_cooker IN.obj OUT.mesh [--vertex auto|full|packed] [--no-optimize]" << std::endl;
+        return 1;
+    }
+    try {
+        const auto& in = paths[0];
+        const auto& out = paths[1];
+        if (in.extension() != ".obj") {
+            throw std::runtime_error("only Wavefront .obj input is supported");
+        }
+
+        auto file = MappedFile(in, MappedFile::Access::sequential);
+        auto obj = parse_obj(file.bytes());
+        if (obj.indices.empty()) {
+            throw std::runtime_error(in.string() + " has no faces");
+        }
+        auto vertex_count = static_cast<uint32_t>(obj.vertices.size());
+        auto acmr_before = vertex_cache_acmr(obj.indices, vertex_count);
+        if (optimize) {
+            obj.indices = optimize_vertex_cache(obj.indices, vertex_count);
+            obj.vertices = optimize_vertex_fetch(obj.vertices, obj.indices);
+            vertex_count = static_cast<uint32_t>(obj.vertices.size());
+        }
+        auto acmr_after = vertex_cache_acmr(obj.indices, vertex_count);
+
+        auto format = (vertex == "full") ? VertexFormat::full : VertexFormat::packed;
+        if (vertex == "auto" && !packs_precisely(obj.vertices)) {
+            format = VertexFormat::full;
+        }
+        auto mesh = Mesh::pack(obj.vertices, obj.indices, format);
+        mesh.save(out);
+        std::cout << out.string() << ": " << mesh.vertex_count() << " vertices, "
+            << mesh.index_count() / 3 << " triangles, "
+            << ((format == VertexFormat::packed) ? "packed" : "full") << " vertices, "
+            << ((mesh.index_type() == VK_INDEX_TYPE_UINT16) ? 16 : 32) << " bit indices, "
+            << mesh.bytes().size() << " bytes, ACMR " << acmr_before << " -> " << acmr_after << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "buffer.h"
+
+// Offline reordering of indexed triangle lists, used by mesh_cooker. Neither
+// step changes what is drawn, only the order the GPU sees it in:
+//
+// - optimize_vertex_cache() reorders triangles so vertices shared between
+//   them are still in the post-transform cache when they come up again,
+//   after Tom Forsyth's "Linear-Speed Vertex Cache Optimisation": every
+//   vertex is scored by its position in a simulated LRU cache and by how
+//   many of its triangles are left, and the next triangle is the best
+//   scoring one touching the cache.
+// - optimize_vertex_fetch() renumbers vertices in the order the indices
+//   first reference them, so vertex fetches walk the buffer forward.
+//
+// Cache first, fetch second, the fetch order follows the triangle order.
+
+// LRU size the scoring simulates, larger than any real cache so the order holds up on all of them
+inline constexpr uint32_t VERTEX_CACHE_SIZE = 32;
+
+inline float cache_vertex_score(uint32_t cache_pos, uint32_t live_tris) noexcept {
+    if (live_tris == 0) {
+        return -1.0f;
+    }
+    auto ret = 0.0f;
+    if (cache_pos < 3) {
+        // the last triangle's vertices, scored equally so its winding does not matter
+        ret = 0.75f;
+    } else if (cache_pos < VERTEX_CACHE_SIZE) {
+        ret = std::pow(1.0f - static_cast<float>(cache_pos - 3) / (VERTEX_CACHE_SIZE - 3), 1.5f);
+    }
+    // favour vertices with few triangles left, finishing them frees their slot for good
+    return ret + 2.0f / std::sqrt(static_cast<float>(live_tris));
+}
+
+// triangle order with better post-transform cache reuse, `indices` is a triangle list
+inline std::vector<uint32_t> optimize_vertex_cache(const std::vector<uint32_t>& indices, uint32_t vertex_count) {
+    constexpr auto NOT_CACHED = std::numeric_limits<uint32_t>::max();
+    auto tri_count = static_cast<uint32_t>(indices.size() / 3);
+
+    // triangles of every vertex, packed into one array
+    auto live = std::vector<uint32_t>(vertex_count, 0);
+    for (auto idx : indices) {
+        ++live[idx];
+    }
+    auto first_tri = std::vector<uint32_t>(vertex_count + 1, 0);
+    for (uint32_t v=0; v<vertex_count; ++v) {
+        first_tri[v + 1] = first_tri[v] + live[v];
+    }
+    auto vert_tris = std::vector<uint32_t>(indices.size());
+    auto fill = std::vector<uint32_t>(first_tri.begin(), first_tri.end() - 1);
+    for (uint32_t i=0; i<indices.size(); ++i) {
+        vert_tris[fill[indices[i]]++] = i / 3;
+    }
+
+    auto cache_pos = std::vector<uint32_t>(vertex_count, NOT_CACHED);
+    auto vert_score = std::vector<float>(vertex_count);
+    for (uint32_t v=0; v<vertex_count; ++v) {
+        vert_score[v] = cache_vertex_score(NOT_CACHED, live[v]);
+    }
+    auto tri_score = std::vector<float>(tri_count);
+    for (uint32_t t=0; t<tri_count; ++t) {
+        tri_score[t] = vert_score[indices[3*t]] + vert_score[indices[3*t + 1]] + vert_score[indices[3*t + 2]];
+    }
+    auto emitted = std::vector<bool>(tri_count, false);
+
+    auto ret = std::vector<uint32_t>{};
+    ret.reserve(indices.size());
+    auto cache = std::vector<uint32_t>{};
+    auto next_cache = std::vector<uint32_t>{};
+    cache.reserve(VERTEX_CACHE_SIZE + 3);
+    next_cache.reserve(VERTEX_CACHE_SIZE + 3);
+    uint32_t scan = 0;
+    auto best = tri_count ? 0u : NOT_CACHED;
+
+    while (best != NOT_CACHED) {
+        emitted[best] = true;
+        const auto* tri = &indices[3 * best];
+        ret.insert(ret.end(), tri, tri + 3);
+
+        // the triangle's vertices move to the front, the rest keep their order behind them
+        next_cache.assign(tri, tri + 3);
+        for (auto v : cache) {
+            if (v != tri[0] && v != tri[1] && v != tri[2]) {
+                next_cache.push_back(v);
+            }
+        }
+        for (uint32_t k=0; k<3; ++k) {
+            auto v = tri[k];
+            --live[v];
+            auto* begin = &vert_tris[first_tri[v]];
+            auto* end = begin + live[v] + 1;
+            // the live triangles stay at the front of the vertex's range
+            std::swap(*std::find(begin, end, best), *(end - 1));
+        }
+
+        // vertices pushed past the cache lose their position score
+        for (uint32_t i=0; i<next_cache.size(); ++i) {
+            auto v = next_cache[i];
+            cache_pos[v] = (i < VERTEX_CACHE_SIZE) ? i : NOT_CACHED;
+            auto score = cache_vertex_score(cache_pos[v], live[v]);
+            auto delta = score - vert_score[v];
+            vert_score[v] = score;
+            for (uint32_t j=first_tri[v]; j<first_tri[v] + live[v]; ++j) {
+                tri_score[vert_tris[j]] += delta;
+            }
+        }
+        next_cache.resize(std::min<size_t>(next_cache.size(), VERTEX_CACHE_SIZE));
+        cache.swap(next_cache);
+
+        // the best live triangle around the cache, else the next one not yet emitted
+        best = NOT_CACHED;
+        auto best_score = -std::numeric_limits<float>::infinity();
+        for (auto v : cache) {
+            for (uint32_t j=first_tri[v]; j<first_tri[v] + live[v]; ++j) {
+                auto t = vert_tris[j];
+                if (tri_score[t] > best_score) {
+                    best = t;
+                    best_score = tri_score[t];
+                }
+            }
+        }
+        if (best == NOT_CACHED) {
+            while (scan < tri_count && emitted[scan]) {
+                ++scan;
+            }
+            best = (scan < tri_count) ? scan : NOT_CACHED;
+        }
+    }
+    return ret;
+}
+
+// renumbers vertices in first-use order and drops unreferenced ones, `indices` is rewritten in place
+inline std::vector<Vertex> optimize_vertex_fetch(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    constexpr auto UNUSED = std::numeric_limits<uint32_t>::max();
+    auto remap = std::vector<uint32_t>(vertices.size(), UNUSED);
+    auto ret = std::vector<Vertex>{};
+    ret.reserve(vertices.size());
+    for (auto& idx : indices) {
+        if (remap[idx] == UNUSED) {
+            remap[idx] = static_cast<uint32_t>(ret.size());
+            ret.push_back(vertices[idx]);
+        }
+        idx = remap[idx];
+    }
+    return ret;
+}
+
+// average vertices transformed per triangle with a FIFO cache of `cache_size`, 0.5 is the ideal, 3 the worst
+inline float vertex_cache_acmr(const std::vector<uint32_t>& indices, uint32_t vertex_count, uint32_t cache_size = 16) {
+    if (indices.empty()) {
+        return 0.0f;
+    }
+    // a vertex is cached while fewer than cache_size misses have happened since its own
+    auto miss_at = std::vector<uint64_t>(vertex_count, 0);
+    uint64_t misses = 0;
+    for (auto idx : indices) {
+        if (miss_at[idx] == 0 || misses - miss_at[idx] >= cache_size) {
+            ++misses;
+            miss_at[idx] = misses;
+        }
+    }
+    return static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+}
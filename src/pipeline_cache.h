@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "device.h"
+#include "utils.h"
+
+// VkPipelineCache persisted to a file between runs. The blob is prefixed
+// with our own header naming the device and driver it was produced by, so a
+// cache from another GPU or an updated driver is discarded instead of being
+// handed to the driver. save() writes to a temporary file and renames it
+// over the old one, a crash mid-write never leaves a truncated cache behind.
+class PipelineCache {
+    private:
+        struct FileHeader {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t vendor_id;
+            uint32_t device_id;
+            uint32_t driver_version;
+            uint8_t uuid[VK_UUID_SIZE];
+            uint64_t data_size;
+            uint64_t checksum;
+        };
+        static constexpr uint32_t MAGIC = 0x43504B56; // "VKPC"
+        static constexpr uint32_t VERSION = 1;
+    public:
+        void init(VulkanDevice dev, const std::filesystem::path& fpath) {
+            dev_ = dev;
+            fpath_ = fpath;
+
+            auto dev_props = VkPhysicalDeviceProperties{};
+            vkGetPhysicalDeviceProperties(dev_.physical, &dev_props);
+            expected_ = FileHeader{};
+            expected_.magic = MAGIC;
+            expected_.version = VERSION;
+            expected_.vendor_id = dev_props.vendorID;
+            expected_.device_id = dev_props.deviceID;
+            expected_.driver_version = dev_props.driverVersion;
+            std::memcpy(expected_.uuid, dev_props.pipelineCacheUUID, VK_UUID_SIZE);
+
+            auto initial = load();
+
+            auto cache_info = VkPipelineCacheCreateInfo{};
+            cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+            cache_info.initialDataSize = initial.size();
+            cache_info.pInitialData = initial.empty() ? nullptr : initial.data();
+
+            auto res = vkCreatePipelineCache(dev_.logical, &cache_info, nullptr, &cache_);
+            if (res != VK_SUCCESS && !initial.empty()) {
+                // the driver rejected data that passed our checks, start over empty
+                cache_info.initialDataSize = 0;
+                cache_info.pInitialData = nullptr;
+                loaded_ = false;
+                res = vkCreatePipelineCache(dev_.logical, &cache_info, nullptr, &cache_);
+            }
+            if (res != VK_SUCCESS) {
+                throw VulkanError("Error creating PipelineCache", res);
+            }
+        }
+
+        // writes the cache back to disk and destroys it
+        void destroy() {
+            save();
+            vkDestroyPipelineCache(dev_.logical, cache_, nullptr);
+            cache_ = VK_NULL_HANDLE;
+        }
+
+        operator VkPipelineCache() const noexcept {
+            return cache_;
+        }
+
+        // true when valid data from a previous run was handed to the driver
+        bool loaded() const noexcept {
+            return loaded_;
+        }
+
+        // failures only cost the next start its warm cache, so they are not fatal
+        bool save() const {
+            size_t size = 0;
+            if (vkGetPipelineCacheData(dev_.logical, cache_, &size, nullptr) != VK_SUCCESS || size == 0) {
+                return false;
+            }
+            auto data = std::vector<uint8_t>(size);
+            if (vkGetPipelineCacheData(dev_.logical, cache_, &size, data.data()) != VK_SUCCESS) {
+                return false;
+            }
+            data.resize(size);
+
+            auto header = expected_;
+            header.data_size = size;
+            header.checksum = checksum(data.data(), size);
+
+            auto tmp_path = fpath_;
+            tmp_path += ".tmp";
+            {
+                auto ofs = std::ofstream(tmp_path, std::ios::binary | std::ios::trunc);
+                ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+                ofs.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(size));
+                if (!ofs.flush()) {
+                    return false;
+                }
+            }
+            auto ec = std::error_code{};
+            std::filesystem::rename(tmp_path, fpath_, ec);
+            return !ec;
+        }
+
+    private:
+        // FNV-1a, only guards against truncated or corrupted files
+        static uint64_t checksum(const uint8_t* data, size_t size) noexcept {
+            auto hash = uint64_t{14695981039346656037ull};
+            for (size_t i=0; i<size; ++i) {
+                hash = (hash ^ data[i]) * 1099511628211ull;
+            }
+            return hash;
+        }
+
+        // returns the driver blob if the file exists and matches this device and driver
+        std::vector<uint8_t> load() {
+            loaded_ = false;
+            auto ec = std::error_code{};
+            if (!std::filesystem::exists(fpath_, ec)) {
+                return {};
+            }
+            auto file = load_file(fpath_);
+            if (file.size() < sizeof(FileHeader)) {
+                return {};
+            }
+
+            auto header = FileHeader{};
+            std::memcpy(&header, file.data(), sizeof(header));
+            auto matches = (
+                header.magic == expected_.magic &&
+                header.version == expected_.version &&
+                header.vendor_id == expected_.vendor_id &&
+                header.device_id == expected_.device_id &&
+                header.driver_version == expected_.driver_version &&
+                std::memcmp(header.uuid, expected_.uuid, VK_UUID_SIZE) == 0 &&
+                header.data_size == file.size() - sizeof(FileHeader)
+            );
+            if (!matches || header.checksum != checksum(file.data() + sizeof(FileHeader), header.data_size)) {
+                return {};
+            }
+
+            loaded_ = true;
+            return std::vector<uint8_t>(file.data() + sizeof(FileHeader), file.data() + file.size());
+        }
+
+        VulkanDevice dev_;
+        std::filesystem::path fpath_;
+        FileHeader expected_;
+        VkPipelineCache cache_ = VK_NULL_HANDLE;
+        bool loaded_ = false;
+};
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <thread>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// How frames reach the display, a trade between latency and power.
+enum class PresentPolicy {
+    // newest frame wins: MAILBOX, or IMMEDIATE (may tear) without it, FIFO as the last resort
+    low_latency,
+    // vsync'd FIFO, the CPU and GPU idle once they are a swapchain ahead
+    power_saving,
+};
+
+// FIFO is the only mode every surface has to support
+inline VkPresentModeKHR choose_present_mode(const std::vector<VkPresentModeKHR>& avail, PresentPolicy policy) {
+    auto has = [&avail](VkPresentModeKHR mode) {
+        return std::find(avail.begin(), avail.end(), mode) != avail.end();
+    };
+    if (policy == PresentPolicy::low_latency) {
+        for (auto mode : {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR}) {
+            if (has(mode)) {
+                return mode;
+            }
+        }
+    }
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+// an sRGB 8 bit format so shaders write linear color, otherwise whatever the surface lists first
+inline VkSurfaceFormatKHR choose_surface_format(const std::vector<VkSurfaceFormatKHR>& avail) {
+    // a lone UNDEFINED entry means the surface takes any format
+    if (avail.size() == 1 && avail[0].format == VK_FORMAT_UNDEFINED) {
+        return VkSurfaceFormatKHR{VK_FORMAT_B8G8R8A8_SRGB, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
+    }
+    for (auto format : {VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_R8G8B8A8_SRGB}) {
+        for (const auto& sfc_fmt : avail) {
+            if (sfc_fmt.format == format && sfc_fmt.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+                return sfc_fmt;
+            }
+        }
+    }
+    return avail.front();
+}
+
+// one image more than the minimum so acquire never waits on the image being presented,
+// MAILBOX needs a third to have a spare to replace; a maxImageCount of 0 means no limit
+inline uint32_t choose_image_count(const VkSurfaceCapabilitiesKHR& caps, VkPresentModeKHR mode) {
+    auto ret = caps.minImageCount + 1;
+    if (mode == VK_PRESENT_MODE_MAILBOX_KHR) {
+        ret = std::max(ret, 3u);
+    }
+    if (caps.maxImageCount > 0) {
+        ret = std::min(ret, caps.maxImageCount);
+    }
+    return ret;
+}
+
+// Caps the frame rate on the CPU. wait() sleeps until shortly before the
+// next frame is due and spins the rest of the way, OS sleeps overshoot by
+// up to a scheduler tick, spinning alone burns a core. A frame that comes
+// in late restarts the schedule instead of rushing to catch up.
+class FrameLimiter {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        // how long before the deadline sleeping hands over to spinning
+        static constexpr std::chrono::microseconds SPIN_MARGIN{1500};
+
+        // 0 disables the limit
+        void set_target_fps(double fps) noexcept {
+            period_ = (fps > 0.0)
+                ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps))
+                : Clock::duration::zero();
+            next_ = Clock::time_point{};
+        }
+
+        bool enabled() const noexcept {
+            return period_ > Clock::duration::zero();
+        }
+
+        // whether wait() would return right away
+        bool ready() const noexcept {
+            return !enabled() || Clock::now() >= next_;
+        }
+
+        // when the next frame is due, only meaningful while enabled()
+        Clock::time_point due() const noexcept {
+            return next_;
+        }
+
+        // blocks until the next frame is due
+        void wait() {
+            if (!enabled()) {
+                return;
+            }
+            auto now = Clock::now();
+            if (next_ > now) {
+                if (next_ - now > SPIN_MARGIN) {
+                    std::this_thread::sleep_until(next_ - SPIN_MARGIN);
+                }
+                while (Clock::now() < next_) {
+                    std::this_thread::yield();
+                }
+                next_ += period_;
+            } else {
+                next_ = now + period_;
+            }
+        }
+
+    private:
+        Clock::duration period_ = Clock::duration::zero();
+        Clock::time_point next_;
+};
+
+// Time from the moment a frame sampled its input to the moment its
+// rendering was seen complete on the GPU, ready for the presentation engine.
+// Completion is only observed when the frame scheduler is asked, so the
+// renderer asks while it blocks on the GPU, including the time the frame
+// limit would otherwise sleep, and the sleep never counts as latency; FIFO
+// adds the wait for the next vblank on top.
+class LatencyTracker {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        void submitted(uint64_t serial, Clock::time_point input) {
+            pending_.push_back(Pending{serial, input});
+        }
+
+        void collect(uint64_t completed_serial) {
+            auto now = Clock::now();
+            while (!pending_.empty() && pending_.front().serial <= completed_serial) {
+                last_ms_ = std::chrono::duration<double, std::milli>(now - pending_.front().input).count();
+                pending_.pop_front();
+            }
+        }
+
+        // serial of the oldest frame whose completion has not been seen, 0 if there is none
+        uint64_t oldest_pending() const noexcept {
+            return pending_.empty() ? 0 : pending_.front().serial;
+        }
+
+        // latency of the most recently completed frame, 0 before the first one
+        double last_ms() const noexcept {
+            return last_ms_;
+        }
+
+    private:
+        struct Pending {
+            uint64_t serial;
+            Clock::time_point input;
+        };
+
+        std::deque<Pending> pending_;
+        double last_ms_ = 0.0;
+};
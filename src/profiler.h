@@ -0,0 +1,288 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "device.h"
+#include "utils.h"
+
+struct GpuTimingStats {
+    size_t count;
+    double last_ms;
+    double mean_ms;
+    double p50_ms;
+    double p95_ms;
+    double max_ms;
+};
+
+// GPU timestamp profiler. Queries are split into slots, one per command
+// buffer that may be in flight at the same time (a frame in flight, an
+// upload batch). begin() resets a slot, inside the command buffer or from
+// the host, scopes write timestamp pairs into it, and collect() reads the
+// slot back once the fence of its submission has signaled, so reading
+// never waits on the GPU.
+class GpuProfiler {
+    private:
+        struct Record {
+            std::string name;
+            uint32_t query;
+        };
+        struct Slot {
+            std::vector<Record> records;
+            uint32_t used = 0;
+        };
+        struct Samples {
+            std::vector<double> ms;
+            size_t next = 0;
+            double last = 0.0;
+        };
+    public:
+        static constexpr size_t DEFAULT_WINDOW = 256;
+        static constexpr uint32_t NO_QUERY = UINT32_MAX;
+
+        // ends a scope when it goes out of scope
+        class Scope {
+            public:
+                Scope(GpuProfiler* profiler, VkCommandBuffer cmd_buf, uint32_t query) noexcept :
+                    profiler_{profiler}, cmd_buf_{cmd_buf}, query_{query} {}
+                Scope(const Scope&) = delete;
+                Scope& operator=(const Scope&) = delete;
+                ~Scope() {
+                    if (profiler_ != nullptr) {
+                        profiler_->end_scope(cmd_buf_, query_);
+                    }
+                }
+            private:
+                GpuProfiler* profiler_;
+                VkCommandBuffer cmd_buf_;
+                uint32_t query_;
+        };
+
+        // VK_EXT_host_query_reset with the hostQueryReset feature
+        static bool host_reset_supported(VkPhysicalDevice dev) {
+            uint32_t ext_cnt = 0;
+            vkEnumerateDeviceExtensionProperties(dev, nullptr, &ext_cnt, nullptr);
+            auto exts = std::vector<VkExtensionProperties>(ext_cnt);
+            vkEnumerateDeviceExtensionProperties(dev, nullptr, &ext_cnt, exts.data());
+            auto has_ext = false;
+            for (const auto& ext : exts) {
+                has_ext = has_ext || std::strcmp(ext.extensionName, VK_EXT_HOST_QUERY_RESET_EXTENSION_NAME) == 0;
+            }
+            if (!has_ext) {
+                return false;
+            }
+
+            auto host_reset = VkPhysicalDeviceHostQueryResetFeaturesEXT{};
+            host_reset.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_QUERY_RESET_FEATURES_EXT;
+            auto features = VkPhysicalDeviceFeatures2{};
+            features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            features.pNext = &host_reset;
+            vkGetPhysicalDeviceFeatures2(dev, &features);
+            return host_reset.hostQueryReset == VK_TRUE;
+        }
+
+        // chain into VkDeviceCreateInfo::pNext of a device that passed host_reset_supported()
+        static VkPhysicalDeviceHostQueryResetFeaturesEXT host_reset_features() noexcept {
+            auto ret = VkPhysicalDeviceHostQueryResetFeaturesEXT{};
+            ret.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_QUERY_RESET_FEATURES_EXT;
+            ret.hostQueryReset = VK_TRUE;
+            return ret;
+        }
+
+        // timestamps are only written where `queue_family` supports them, otherwise every call is a no-op.
+        // `host_reset` resets slots from the CPU in begin(), for queue families without
+        // vkCmdResetQueryPool (transfer only) on a device with hostQueryReset enabled
+        void init(
+            VulkanDevice dev, uint32_t queue_family, uint32_t slot_cnt, uint32_t scopes_per_slot = 16,
+            bool host_reset = false
+        ) {
+            dev_ = dev;
+            reset_query_pool_ = host_reset
+                ? reinterpret_cast<PFN_vkResetQueryPoolEXT>(vkGetDeviceProcAddr(dev_.logical, "vkResetQueryPoolEXT"))
+                : nullptr;
+
+            auto dev_props = VkPhysicalDeviceProperties{};
+            vkGetPhysicalDeviceProperties(dev_.physical, &dev_props);
+
+            uint32_t qfam_cnt;
+            vkGetPhysicalDeviceQueueFamilyProperties(dev_.physical, &qfam_cnt, nullptr);
+            auto qfams = std::vector<VkQueueFamilyProperties>(qfam_cnt);
+            vkGetPhysicalDeviceQueueFamilyProperties(dev_.physical, &qfam_cnt, qfams.data());
+
+            auto valid_bits = qfams[queue_family].timestampValidBits;
+            if (valid_bits == 0 || dev_props.limits.timestampPeriod == 0.0f) {
+                return;
+            }
+            period_ns_ = dev_props.limits.timestampPeriod;
+            mask_ = (valid_bits >= 64) ? UINT64_MAX : ((uint64_t{1} << valid_bits) - 1);
+            queries_per_slot_ = 2 * scopes_per_slot;
+            slots_.resize(slot_cnt);
+
+            auto pool_info = VkQueryPoolCreateInfo{};
+            pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            pool_info.queryCount = queries_per_slot_ * slot_cnt;
+            if (auto res = vkCreateQueryPool(dev_.logical, &pool_info, nullptr, &pool_); res != VK_SUCCESS) {
+                throw VulkanError("Error creating QueryPool", res);
+            }
+        }
+
+        void destroy() {
+            if (pool_ != VK_NULL_HANDLE) {
+                vkDestroyQueryPool(dev_.logical, pool_, nullptr);
+                pool_ = VK_NULL_HANDLE;
+            }
+            slots_.clear();
+        }
+
+        bool enabled() const noexcept {
+            return pool_ != VK_NULL_HANDLE;
+        }
+
+        uint32_t slot_count() const noexcept {
+            return static_cast<uint32_t>(slots_.size());
+        }
+
+        // number of samples kept per scope for averages and percentiles
+        void set_window(size_t window) {
+            window_ = std::max<size_t>(window, 1);
+            reset_stats();
+        }
+
+        void reset_stats() {
+            samples_.clear();
+        }
+
+        // must be recorded before any scope of `slot`, outside of a render pass; with host resets
+        // the slot's previous submission has to have completed
+        void begin(VkCommandBuffer cmd_buf, uint32_t slot) {
+            if (!enabled() || slot >= slots_.size()) {
+                return;
+            }
+            auto& s = slots_[slot];
+            s.records.clear();
+            s.used = 0;
+            if (reset_query_pool_ != nullptr) {
+                reset_query_pool_(dev_.logical, pool_, slot * queries_per_slot_, queries_per_slot_);
+            } else {
+                vkCmdResetQueryPool(cmd_buf, pool_, slot * queries_per_slot_, queries_per_slot_);
+            }
+        }
+
+        [[nodiscard]] Scope scope(VkCommandBuffer cmd_buf, uint32_t slot, const std::string& name) {
+            auto query = begin_scope(cmd_buf, slot, name);
+            return Scope((query != NO_QUERY) ? this : nullptr, cmd_buf, query);
+        }
+
+        // for scopes that span several calls; scopes past the capacity of the slot are dropped (NO_QUERY)
+        uint32_t begin_scope(VkCommandBuffer cmd_buf, uint32_t slot, const std::string& name) {
+            if (!enabled() || slot >= slots_.size() || slots_[slot].used + 2 > queries_per_slot_) {
+                return NO_QUERY;
+            }
+            auto& s = slots_[slot];
+            auto query = slot * queries_per_slot_ + s.used;
+            s.used += 2;
+            s.records.push_back(Record{name, query});
+            vkCmdWriteTimestamp(cmd_buf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, pool_, query);
+            return query;
+        }
+
+        void end_scope(VkCommandBuffer cmd_buf, uint32_t query) {
+            if (query != NO_QUERY) {
+                vkCmdWriteTimestamp(cmd_buf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pool_, query + 1);
+            }
+        }
+
+        // call once the submission that recorded `slot` has completed; unwritten queries are skipped
+        // and a slot is read only once per begin()
+        void collect(uint32_t slot) {
+            if (!enabled() || slot >= slots_.size()) {
+                return;
+            }
+            auto& s = slots_[slot];
+            for (const auto& rec : s.records) {
+                uint64_t ticks[2];
+                auto res = vkGetQueryPoolResults(
+                    dev_.logical, pool_, rec.query, 2,
+                    sizeof(ticks), ticks, sizeof(ticks[0]), VK_QUERY_RESULT_64_BIT
+                );
+                if (res != VK_SUCCESS) {
+                    continue;
+                }
+                auto elapsed = (ticks[1] - ticks[0]) & mask_;
+                add_sample(rec.name, static_cast<double>(elapsed) * period_ns_ * 1e-6);
+            }
+            s.records.clear();
+        }
+
+        std::vector<std::string> names() const {
+            auto ret = std::vector<std::string>{};
+            for (const auto& [name, _] : samples_) {
+                ret.push_back(name);
+            }
+            return ret;
+        }
+
+        GpuTimingStats stats(const std::string& name) const {
+            auto ret = GpuTimingStats{};
+            auto it = samples_.find(name);
+            if (it == samples_.end() || it->second.ms.empty()) {
+                return ret;
+            }
+            auto sorted = it->second.ms;
+            std::sort(sorted.begin(), sorted.end());
+            auto percentile = [&sorted](double p) {
+                auto idx = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+                return sorted[std::min(idx, sorted.size() - 1)];
+            };
+
+            ret.count = sorted.size();
+            ret.last_ms = it->second.last;
+            for (auto ms : sorted) {
+                ret.mean_ms += ms;
+            }
+            ret.mean_ms /= static_cast<double>(sorted.size());
+            ret.p50_ms = percentile(0.50);
+            ret.p95_ms = percentile(0.95);
+            ret.max_ms = sorted.back();
+            return ret;
+        }
+
+        void report(std::ostream& os) const {
+            for (const auto& name : names()) {
+                auto s = stats(name);
+                os << name << ": mean " << s.mean_ms << " ms, p50 " << s.p50_ms
+                   << " ms, p95 " << s.p95_ms << " ms, max " << s.max_ms
+                   << " ms (" << s.count << " samples)\n";
+            }
+        }
+
+    private:
+        void add_sample(const std::string& name, double ms) {
+            auto& s = samples_[name];
+            s.last = ms;
+            if (s.ms.size() < window_) {
+                s.ms.push_back(ms);
+            } else {
+                s.ms[s.next] = ms;
+                s.next = (s.next + 1) % window_;
+            }
+        }
+
+        VulkanDevice dev_;
+        VkQueryPool pool_ = VK_NULL_HANDLE;
+        PFN_vkResetQueryPoolEXT reset_query_pool_ = nullptr;
+        float period_ns_ = 1.0f;
+        uint64_t mask_ = UINT64_MAX;
+        uint32_t queries_per_slot_ = 0;
+        std::vector<Slot> slots_;
+        size_t window_ = DEFAULT_WINDOW;
+        std::map<std::string, Samples> samples_;
+};
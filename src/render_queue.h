@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Packs what a draw's order depends on into one integer, most significant
+// first, so sorting draws is sorting integers:
+//   [63:56] pipeline, [55:32] material, [31:0] view depth
+// Opaque draws group by pipeline and material to save state changes and go
+// front to back within a group, so early depth testing rejects the
+// fragments of everything behind what was already drawn.
+struct SortKey {
+    static constexpr uint32_t PIPELINE_BITS = 8;
+    static constexpr uint32_t MATERIAL_BITS = 24;
+
+    // `depth` is the distance along the view direction, anything behind the eye sorts first
+    static uint64_t opaque(uint32_t pipeline, uint32_t material, float depth) noexcept {
+        // non-negative floats order like their bit patterns
+        auto depth_bits = std::bit_cast<uint32_t>(std::max(depth, 0.0f));
+        return (
+            (uint64_t{pipeline & ((1u << PIPELINE_BITS) - 1)} << (MATERIAL_BITS + 32)) |
+            (uint64_t{material & ((1u << MATERIAL_BITS) - 1)} << 32) |
+            uint64_t{depth_bits}
+        );
+    }
+};
+
+// Draws of one pass collected with their sort keys and ordered by them.
+// Sorting is an LSD radix sort over the key bytes that skips every byte all
+// keys share, typically the pipeline and most of the material, so a frame
+// of 100k draws sorts in a handful of linear passes instead of n log n
+// comparisons. Items are opaque indices into the caller's draw list.
+class RenderQueue {
+    public:
+        struct Entry {
+            uint64_t key;
+            uint32_t item;
+        };
+
+        void clear() noexcept {
+            entries_.clear();
+        }
+
+        void reserve(size_t count) {
+            entries_.reserve(count);
+        }
+
+        void push(uint64_t key, uint32_t item) {
+            entries_.push_back(Entry{key, item});
+        }
+
+        // stable, equal keys keep the order they were pushed in
+        void sort() {
+            scratch_.resize(entries_.size());
+            for (uint32_t shift=0; shift<64; shift+=8) {
+                auto counts = std::array<size_t, 256>{};
+                for (const auto& entry : entries_) {
+                    ++counts[(entry.key >> shift) & 0xff];
+                }
+                if (std::find(counts.begin(), counts.end(), entries_.size()) != counts.end()) {
+                    continue;
+                }
+
+                size_t offset = 0;
+                for (auto& count : counts) {
+                    offset += std::exchange(count, offset);
+                }
+                for (const auto& entry : entries_) {
+                    scratch_[counts[(entry.key >> shift) & 0xff]++] = entry;
+                }
+                entries_.swap(scratch_);
+            }
+        }
+
+        size_t size() const noexcept {
+            return entries_.size();
+        }
+
+        const std::vector<Entry>& entries() const noexcept {
+            return entries_;
+        }
+
+    private:
+        std::vector<Entry> entries_;
+        std::vector<Entry> scratch_;
+};
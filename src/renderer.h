@@ -2,12 +2,17 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <cstdint>
 #include <cstring>
+#include <deque>
 #include <exception>
+#include <filesystem>
+#include <iostream>
 #include <memory>
 #include <optional>
 #include <set>
+#include <thread>
 #include <vector>
 
 #define GLFW_INCLUDE_VULKAN
@@ -18,46 +23,292 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "allocator.h"
+#include "bindless.h"
 #include "buffer.h"
+#include "compressed.h"
+#include "culling.h"
 #include "descr.h"
+#include "descriptors.h"
 #include "device.h"
+#include "frame_scheduler.h"
+#include "headless.h"
+#include "jobs.h"
+#include "mesh.h"
+#include "pipeline_cache.h"
+#include "present.h"
+#include "profiler.h"
+#include "render_queue.h"
 #include "shader.h"
+#include "staging.h"
+#include "streaming.h"
 #include "texture.h"
+#include "uniform_ring.h"
+#include "upload.h"
 #include "utils.h"
 #include "validation.h"
 
+// Content the renderer starts out with. Objects are laid out on a grid
+// until set_instances() replaces them; a texture_size of 0 streams in
+// texture.jpg (or a cooked copy) behind a placeholder, otherwise
+// texture_count checkerboards of that size are generated so runs are
+// reproducible. With bindless textures the objects cycle through them,
+// otherwise only the first is drawn. Every object is the same mesh, a file
+// written by mesh_cooker or the unit quad if `mesh` is empty.
+struct SceneDesc {
+    uint32_t object_count = 1;
+    uint32_t texture_size = 0;
+    uint32_t texture_count = 1;
+    std::filesystem::path mesh = {};
+};
+
+struct UploadStats {
+    VkDeviceSize bytes;
+    double seconds;
+};
+
 class VulkanRenderer {
     private:
         struct Queue {
             uint32_t idx;
             VkQueue queue;
         };
+        struct WorkerCommands {
+            VkCommandPool cmd_pool;
+            VkCommandBuffer cmd_buf;
+        };
+        struct FrameResources {
+            VkCommandPool cmd_pool;
+            VkCommandBuffer cmd_buf;
+            // secondary buffers recorded in parallel, empty when recording on one thread
+            std::vector<WorkerCommands> workers;
+            VkBuffer instance_buffer = VK_NULL_HANDLE;
+            Allocation instance_mem;
+            size_t instance_capacity = 0;
+            uint32_t ubo_offset = 0;
+            DrawPushConstants draw_constants;
+            // transient sets, reset once the frame's fence has signaled
+            DescriptorAllocator descriptors;
+        };
+
+        // one for all frames in flight, they only touch it one after another on the graphics queue
+        struct DepthTarget {
+            VkImage image = VK_NULL_HANDLE;
+            VkImageView view = VK_NULL_HANDLE;
+            Allocation mem;
+        };
+        struct RetiredSwapchain {
+            uint64_t serial;
+            VkSwapchainKHR swapchain;
+            std::vector<VkImageView> views;
+            std::vector<VkFramebuffer> framebuffers;
+            DepthTarget depth;
+            VkRenderPass render_pass = VK_NULL_HANDLE;
+            VkPipeline pipeline = VK_NULL_HANDLE;
+        };
     public:
-        static const uint8_t MAX_FRAMES_IN_FLIGHT = 2;
+        // relative to the working directory, i.e. next to the executable
+        static constexpr const char* PIPELINE_CACHE_FILE = "pipeline_cache.bin";
+        // edge of the checkerboard bound while the scene texture streams in
+        static constexpr uint32_t PLACEHOLDER_TEXTURE_SIZE = 64;
         VulkanRenderer(GLFWwindow* win) noexcept :
         win_(win) {}
 
+        // headless: renders into `img_cnt` offscreen images of the given size instead of a swapchain
+        VulkanRenderer(VkExtent2D extent, uint32_t img_cnt = 3) noexcept :
+        win_(nullptr), offscreen_extent_(extent), offscreen_img_cnt_(img_cnt) {}
+
+        bool headless() const noexcept {
+            return win_ == nullptr;
+        }
+
+        // receives every finished frame in headless mode, a few frames after it was drawn
+        void set_frame_callback(FrameCallback callback) {
+            offscreen_.set_callback(std::move(callback));
+        }
+
+        // must be called before init()
+        void set_scene(const SceneDesc& scene) noexcept {
+            scene_ = scene;
+        }
+
+        // objects drawn from the next frame on, all in one instanced draw
+        void set_instances(std::vector<InstanceData> instances) {
+            instances_ = std::move(instances);
+        }
+
+        std::vector<InstanceData>& instances() noexcept {
+            return instances_;
+        }
+
+        // `count` objects on a square grid scaled to fit the unit quad's footprint
+        static std::vector<InstanceData> grid_instances(uint32_t count) {
+            auto cols = std::max(static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count)))), 1u);
+            auto scale = 1.0f / static_cast<float>(cols);
+            auto center = 0.5f * static_cast<float>(cols - 1);
+
+            auto ret = std::vector<InstanceData>(count);
+            for (uint32_t i=0; i<count; ++i) {
+                auto cell = glm::vec3(static_cast<float>(i % cols) - center, static_cast<float>(i / cols) - center, 0.0f);
+                ret[i].model = glm::translate(glm::scale(glm::mat4(1.0f), glm::vec3(scale)), cell);
+            }
+            return ret;
+        }
+
+        // threads recording each frame's draws into secondary command buffers, 0 uses every core;
+        // must be called before init()
+        void set_record_threads(uint32_t threads) noexcept {
+            record_threads_ = threads;
+        }
+
+        // test objects against the view frustum in a compute pass and draw the survivors indirectly;
+        // must be called before init()
+        void set_gpu_culling(bool enabled) noexcept {
+            gpu_culling_ = enabled;
+        }
+
+        // sample textures from one descriptor array indexed per instance where the device supports
+        // descriptor indexing, instead of one combined image sampler; must be called before init()
+        void set_bindless(bool enabled) noexcept {
+            bindless_requested_ = enabled;
+        }
+
+        bool bindless() const noexcept {
+            return use_bindless_;
+        }
+
+        // bindless slots of the scene textures, for InstanceData::texture; empty without bindless textures
+        const std::vector<uint32_t>& texture_slots() const noexcept {
+            return texture_slots_;
+        }
+
+        // frames recorded ahead of the GPU, each with its own uniforms, descriptors and command buffers;
+        // must be called before init()
+        void set_frames_in_flight(uint32_t frames) noexcept {
+            frames_in_flight_ = std::max(frames, 1u);
+        }
+
+        uint32_t frames_in_flight() const noexcept {
+            return frames_in_flight_;
+        }
+
+        // write instances front to back every frame so early depth testing culls hidden fragments,
+        // otherwise in the order they were set
+        void set_sort_draws(bool enabled) noexcept {
+            sort_draws_ = enabled;
+        }
+
+        // CPU time the last frame spent writing instance data and recording command buffers
+        double record_ms() const noexcept {
+            return record_ms_;
+        }
+
+        // CPU time the last frame spent blocked until its frame slot or swapchain image was free
+        double stall_ms() const noexcept {
+            return stall_ms_;
+        }
+
+        // picks the present mode whenever the swapchain is created; must be called before init()
+        void set_present_policy(PresentPolicy policy) noexcept {
+            present_policy_ = policy;
+        }
+
+        // the mode the swapchain presents with, FIFO in headless mode
+        VkPresentModeKHR present_mode() const noexcept {
+            return swapchain_settings_.present_mode;
+        }
+
+        // caps the frame rate on the CPU, 0 lifts the cap
+        void set_frame_limit(double fps) noexcept {
+            limiter_.set_target_fps(fps);
+        }
+
+        // input-to-present latency of the most recently completed frame, see LatencyTracker
+        double latency_ms() const noexcept {
+            return latency_.last_ms();
+        }
+
+        // advance animation by `seconds` per frame instead of following the wall clock, 0 disables
+        void set_fixed_timestep(float seconds) noexcept {
+            fixed_dt_ = seconds;
+        }
+
+        // blocks until every texture requested so far is resident and bound
+        void wait_for_textures() {
+            streamer_.wait_all();
+        }
+
+        // blocks until the uploads issued by init() are complete; the time is what the upload path
+        // spent staging, submitting and waiting, texture generation and the rest of init() excluded
+        UploadStats finish_initial_uploads() {
+            uploads_.wait(init_upload_ticket_);
+            auto ret = UploadStats{};
+            ret.bytes = init_upload_bytes_;
+            ret.seconds = uploads_.busy_seconds();
+            return ret;
+        }
+
+        // per-frame GPU timings under the scopes "frame", "cull" and "render_pass"
+        GpuProfiler& gpu_profiler() noexcept {
+            return profiler_;
+        }
+
+        // GPU time of upload batches under the scope "upload"
+        GpuProfiler& upload_profiler() noexcept {
+            return uploads_.gpu_profiler();
+        }
+
+        // print the GPU timing report in destroy()
+        void set_profiler_report(bool enabled) noexcept {
+            profiler_report_ = enabled;
+        }
+
         void destroy() {
             vkDeviceWaitIdle(dev_.logical);
-            for (size_t i=0; i<MAX_FRAMES_IN_FLIGHT; ++i) {
-                vkDestroySemaphore(dev_.logical, render_finished_[i], nullptr);
-                vkDestroySemaphore(dev_.logical, image_available_[i], nullptr);
-                vkDestroyFence(dev_.logical, frame_done_[i], nullptr);
+            if (headless()) {
+                offscreen_.collect_all();
             }
+            for (uint32_t i=0; i<frames_in_flight_; ++i) {
+                profiler_.collect(i);
+            }
+            streamer_.destroy();
+            uploads_.poll();
+            if (profiler_report_) {
+                std::cout << "GPU timings:\n";
+                profiler_.report(std::cout);
+                uploads_.gpu_profiler().report(std::cout);
+            }
+            scheduler_.destroy();
+            release_retired(true);
             cleanup_swapchain();
-            vkDestroyDescriptorSetLayout(dev_.logical, desc_set_layout_, nullptr);
+            vkDestroyPipeline(dev_.logical, pipeline_, nullptr);
+            vkDestroyPipelineLayout(dev_.logical, pl_layout_, nullptr);
+            vkDestroyRenderPass(dev_.logical, render_pass_, nullptr);
 
-            vkDestroyBuffer(dev_.logical, idx_buffer_, nullptr);
-            vkFreeMemory(dev_.logical, idx_mem_, nullptr);
-            vkDestroyBuffer(dev_.logical, vert_buffer_, nullptr);
-            vkFreeMemory(dev_.logical, vert_mem_, nullptr);
-            vkDestroyImageView(dev_.logical, tex_image_view_, nullptr);
-            vkDestroyImage(dev_.logical, tex_image_, nullptr);
-            vkFreeMemory(dev_.logical, tex_mem_, nullptr);
+            destroy_buffer(dev_, allocator_, idx_buffer_, idx_mem_);
+            destroy_buffer(dev_, allocator_, vert_buffer_, vert_mem_);
+            for (auto& tex : textures_) {
+                destroy_texture_image(dev_, allocator_, tex);
+            }
+            textures_.clear();
+            if (use_bindless_) {
+                bindless_.destroy();
+            }
 
             vkDestroySampler(dev_.logical, tex_sampler_, nullptr);
 
-            vkDestroyCommandPool(dev_.logical, command_pool_, nullptr);
+            destroy_frame_resources();
+            jobs_.destroy();
+            profiler_.destroy();
+            uploads_.destroy();
+            staging_.destroy(allocator_);
+            if (gpu_culling_) {
+                culler_.destroy(allocator_);
+            }
+            uniforms_.destroy(allocator_);
+            descriptors_.destroy();
+            allocator_.destroy();
+            pipeline_cache_.destroy();
             vkDestroyDevice(dev_.logical, nullptr);
 #ifndef NDEBUG
             {
@@ -67,7 +318,9 @@ class VulkanRenderer {
                 func(inst_, dbg_msngr_, nullptr);
             }
 #endif
-            vkDestroySurfaceKHR(inst_, surf_, nullptr);
+            if (!headless()) {
+                vkDestroySurfaceKHR(inst_, surf_, nullptr);
+            }
             vkDestroyInstance(inst_, nullptr);
         }
 
@@ -76,100 +329,111 @@ class VulkanRenderer {
 #ifndef NDEBUG
             setup_dbg_msngr();
 #endif
-            create_surface();
+            if (!headless()) {
+                create_surface();
+            }
             create_device();
             create_logical_device();
+            pipeline_cache_.init(dev_, PIPELINE_CACHE_FILE);
+            allocator_.init(dev_);
             create_swapchain();
+            depth_format_ = choose_depth_format(dev_.physical);
+            depth_ = create_depth_target();
             create_render_pass();
+            descriptors_.init(dev_);
             create_descriptor_set_layout();
+            if (use_bindless_) {
+                bindless_.init(dev_);
+            }
+            // mapped until its blobs are staged below, the pipeline's vertex input follows its format
+            auto mesh = scene_.mesh.empty() ? Mesh::quad() : Mesh::load(scene_.mesh);
+            mesh_index_count_ = mesh.index_count();
+            mesh_index_type_ = mesh.index_type();
+            mesh_vertex_format_ = mesh.vertex_format();
+            create_pipeline_layout();
             create_gfx_pipeline();
             create_framebuffers();
-            create_command_pool();
-            create_tex_image();
+            jobs_.init((record_threads_ > 0) ? record_threads_ : std::max(std::thread::hardware_concurrency(), 1u));
+            create_frame_resources();
+            profiler_.init(dev_, queues_.graphics.idx, frames_in_flight_);
+            staging_.init(dev_, allocator_);
+            uniforms_.init(dev_, allocator_, frames_in_flight_);
+            gpu_culling_ = gpu_culling_ && graphics_supports_compute();
+            if (gpu_culling_) {
+                culler_.init(dev_, allocator_, pipeline_cache_, descriptors_, frames_in_flight_, mesh.radius());
+            }
+            uploads_.init(
+                dev_, staging_,
+                queues_.transfer.idx, queues_.transfer.queue,
+                queues_.graphics.idx, queues_.graphics.queue,
+                host_query_reset_
+            );
+            streamer_.init(dev_, allocator_, uploads_, std::max(std::thread::hardware_concurrency(), 2u) - 1);
             tex_sampler_ = create_texture_sampler(dev_);
-            create_vert_buffer();
-            create_idx_buffer();
-            create_uniform_buffers();
-            create_desc_pool();
-            create_desc_sets();
-            create_command_buffers();
-            create_semaphores();
-        }
-
-        void draw_frame() {
-            vkWaitForFences(dev_.logical, 1, &frame_done_[curr_frame_], VK_TRUE, UINT64_MAX);
-
-            uint32_t img_idx;
-            {
-                auto res = vkAcquireNextImageKHR(
-                    dev_.logical, swap_chain_, UINT64_MAX,
-                    image_available_[curr_frame_], VK_NULL_HANDLE, &img_idx
-                );
-                if (res == VK_ERROR_OUT_OF_DATE_KHR) {
-                    recreate_swapchain();
-                    return;
-                } else if (res != VK_SUCCESS) {
-                    throw VulkanError("Error aquiring Swapchain Image", res);
+            create_tex_image();
+            create_vert_buffer(mesh);
+            create_idx_buffer(mesh);
+            // the first frame is submitted to the graphics queue after the barrier (or acquire) closing this batch
+            init_upload_ticket_ = uploads_.flush();
+            init_upload_bytes_ = uploads_.bytes_uploaded();
+            desc_set_ = create_desc_set(textures_.front().view);
+            scheduler_.init(dev_, frames_in_flight_, !headless());
+            frame_img_.assign(frames_in_flight_, NO_IMAGE);
+            image_serial_.assign(sc_imgs_.size(), 0);
+            if (instances_.empty()) {
+                instances_ = grid_instances(scene_.object_count);
+                for (size_t i=0; i<instances_.size() && !texture_slots_.empty(); ++i) {
+                    instances_[i].texture = texture_slots_[i % texture_slots_.size()];
                 }
             }
+            t0_ = std::chrono::steady_clock::now();
+        }
 
-            if (frame_in_flight_[img_idx] != VK_NULL_HANDLE) {
-                vkWaitForFences(dev_.logical, 1, &frame_in_flight_[img_idx], VK_TRUE, UINT64_MAX);
-            }
-            frame_in_flight_[img_idx] = frame_done_[curr_frame_];
-
-            update_uniform_buffers(img_idx);
-
-            auto submit_info = VkSubmitInfo{};
-            submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-            VkSemaphore wait_semas[] = {image_available_[curr_frame_]};
-            VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-            submit_info.waitSemaphoreCount = sizeof(wait_semas) / sizeof(wait_semas[0]);
-            submit_info.pWaitSemaphores = wait_semas;
-            submit_info.pWaitDstStageMask = wait_stages;
-            submit_info.commandBufferCount = 1;
-            submit_info.pCommandBuffers = &command_buffers_[img_idx];
-            VkSemaphore signal_semas[] = {render_finished_[curr_frame_]};
-            submit_info.signalSemaphoreCount = 1;
-            submit_info.pSignalSemaphores = signal_semas;
+        // waits out the frame limit and for a free frame slot, then takes the frame's input time;
+        // call it right before polling input so the frame starts from the freshest input,
+        // draw_frame() paces by itself if it was not called
+        void pace_frame() {
+            observe_completion();
+            limiter_.wait();
+            curr_frame_ = scheduler_.begin_frame();
+            begin_input();
+        }
 
-            vkResetFences(dev_.logical, 1, &frame_done_[curr_frame_]);
-            {
-                auto res = vkQueueSubmit(queues_.graphics.queue, 1, &submit_info, frame_done_[curr_frame_]);
-                if (res != VK_SUCCESS) {
-                    throw VulkanError("Error submitting Queue", res);
-                }
+        // blocks until the frame limit allows a frame and a slot is free
+        void draw_frame() {
+            if (!paced_) {
+                pace_frame();
             }
+            render_frame();
+        }
 
-            auto pres_info = VkPresentInfoKHR{};
-            pres_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-            pres_info.waitSemaphoreCount = sizeof(signal_semas) / sizeof(signal_semas[0]);
-            pres_info.pWaitSemaphores = signal_semas;
-            VkSwapchainKHR swapchains[] = {swap_chain_};
-            pres_info.swapchainCount = sizeof(swapchains) / sizeof(swapchains[0]);
-            pres_info.pSwapchains = swapchains;
-            pres_info.pImageIndices = &img_idx;
-            pres_info.pResults = nullptr;
-
-            {
-                auto res = vkQueuePresentKHR(queues_.present.queue, &pres_info);
-                if ((res == VK_ERROR_OUT_OF_DATE_KHR) || (res == VK_SUBOPTIMAL_KHR) || window_resized_) {
-                    recreate_swapchain();
-                } else if (res != VK_SUCCESS) {
-                    throw VulkanError("Error presenting Queue", res);
+        // draws a frame only if the limit allows one and a slot is free without waiting, false if it skipped
+        bool try_draw_frame() {
+            if (!paced_) {
+                if (!limiter_.ready()) {
+                    return false;
                 }
+                auto slot = scheduler_.try_begin_frame();
+                if (!slot) {
+                    return false;
+                }
+                // due already, only advances the schedule
+                limiter_.wait();
+                curr_frame_ = *slot;
+                begin_input();
             }
-            curr_frame_ = (curr_frame_+1) % MAX_FRAMES_IN_FLIGHT;
+            render_frame();
+            return true;
         }
 
-        void update_uniform_buffers(uint32_t img_idx) {
-            static auto t0 = std::chrono::high_resolution_clock::now();
-            auto dt = std::chrono::duration<float, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - t0);
+        // writes the frame's uniform block and the push constants of its draw
+        void update_uniforms(FrameResources& frame) {
+            auto t = animation_time();
 
             auto ubo = UniformBufferObject{};
-            ubo.model = glm::rotate(
+            auto model = glm::rotate(
                 glm::mat4(1.0f),
-                dt.count() * glm::radians(90.0f),
+                t * glm::radians(90.0f),
                 glm::vec3(0.0f, 0.0f, 1.0f)
             );
             ubo.view = glm::lookAt(
@@ -182,11 +446,10 @@ class VulkanRenderer {
                 swapchain_settings_.extent.width/(float)swapchain_settings_.extent.height,
                 0.1f, 10.0f
             );
+            ubo.view_proj = ubo.proj * ubo.view;
 
-            void* data = nullptr;
-            vkMapMemory(dev_.logical, uniform_mems_[img_idx], 0, sizeof(ubo), 0, &data);
-            std::memcpy(data, reinterpret_cast<void*>(&ubo), sizeof(ubo));
-            vkUnmapMemory(dev_.logical, uniform_mems_[img_idx]);
+            frame.ubo_offset = uniforms_.push(ubo);
+            frame.draw_constants.mvp = ubo.view_proj * model;
         }
 
         static void win_resize_handler(GLFWwindow* win, int width, int height) {
@@ -195,6 +458,15 @@ class VulkanRenderer {
         }
 
     private:
+        static constexpr uint32_t NO_IMAGE = UINT32_MAX;
+
+        float animation_time() {
+            if (fixed_dt_ > 0.0f) {
+                return static_cast<float>(frame_cnt_++) * fixed_dt_;
+            }
+            return std::chrono::duration<float>(std::chrono::steady_clock::now() - t0_).count();
+        }
+
         void create_instance() {
             VkApplicationInfo app_info{};
             app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -260,15 +532,30 @@ class VulkanRenderer {
                 auto dev_features = VkPhysicalDeviceFeatures{};
                 vkGetPhysicalDeviceFeatures(dev, &dev_features);
 
+                if (headless()) {
+                    // without a surface any device with a graphics queue will do
+                    auto qfams = std::vector<VkQueueFamilyProperties>(queue_cnt);
+                    vkGetPhysicalDeviceQueueFamilyProperties(dev, &queue_cnt, qfams.data());
+                    auto has_gfx = filter_queues(qfams, [](const VkQueueFamilyProperties& qfam) -> bool {
+                        return (qfam.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0 && (qfam.queueCount > 0);
+                    });
+                    if (has_gfx && (dev_features.samplerAnisotropy == VK_TRUE) && FrameScheduler::device_supports(dev)) {
+                        dev_.physical = dev;
+                        return;
+                    }
+                    continue;
+                }
+
                 VkBool32 supported;
                 for (uint32_t idx=0; idx<queue_cnt; ++idx) {
                     vkGetPhysicalDeviceSurfaceSupportKHR(dev, idx, surf_, &supported);
-                    if (supported && (dev_features.samplerAnisotropy == VK_TRUE)) {
+                    if (supported && (dev_features.samplerAnisotropy == VK_TRUE) && FrameScheduler::device_supports(dev)) {
                         dev_.physical = dev;
                         return;
                     }
                 }
             }
+            throw std::runtime_error("No suitable physical device found");
         }
 
         void create_logical_device() {
@@ -289,10 +576,13 @@ class VulkanRenderer {
             }
             queues_.graphics.idx = *gfx_queue_idx;
 
-            // find present queue
+            // find present queue, headless frames never leave the graphics queue
             auto present_queue_idx = std::optional<uint32_t>{std::nullopt};
+            if (headless()) {
+                present_queue_idx = gfx_queue_idx;
+            }
             VkBool32 supported;
-            for (uint32_t idx=0; idx<qfam_cnt; ++idx) {
+            for (uint32_t idx=0; idx<qfam_cnt && !present_queue_idx; ++idx) {
                 vkGetPhysicalDeviceSurfaceSupportKHR(dev_.physical, idx, surf_, &supported);
                 if (supported) {
                     present_queue_idx = idx;
@@ -304,7 +594,20 @@ class VulkanRenderer {
             }
             queues_.present.idx = *present_queue_idx;
 
-            auto idxs = std::set<uint32_t>{*present_queue_idx, *gfx_queue_idx};
+            // find a transfer-only queue for uploads; copies at texel granularity are required
+            // since uploads split images into row bands, otherwise uploads share the graphics queue
+            auto transfer_queue_idx = filter_queues(qfams, [](const VkQueueFamilyProperties& qfam) -> bool {
+                const auto& granularity = qfam.minImageTransferGranularity;
+                return (
+                    (qfam.queueFlags & VK_QUEUE_TRANSFER_BIT) != 0 &&
+                    (qfam.queueFlags & VK_QUEUE_GRAPHICS_BIT) == 0 &&
+                    (qfam.queueCount > 0) &&
+                    granularity.width == 1 && granularity.height == 1 && granularity.depth == 1
+                );
+            });
+            queues_.transfer.idx = transfer_queue_idx.value_or(*gfx_queue_idx);
+
+            auto idxs = std::set<uint32_t>{*present_queue_idx, *gfx_queue_idx, queues_.transfer.idx};
 
             auto queue_create_infos = std::vector<VkDeviceQueueCreateInfo>{};
             auto q_prio = 1.0f;
@@ -318,8 +621,12 @@ class VulkanRenderer {
                 queue_create_infos.push_back(queue_info);
             };
 
+            auto avail_features = VkPhysicalDeviceFeatures{};
+            vkGetPhysicalDeviceFeatures(dev_.physical, &avail_features);
+
             auto dev_features = VkPhysicalDeviceFeatures{};
             dev_features.samplerAnisotropy = VK_TRUE;
+            dev_features.textureCompressionBC = avail_features.textureCompressionBC;
 
             VkDeviceCreateInfo ldev_info{};
             ldev_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -327,6 +634,24 @@ class VulkanRenderer {
             ldev_info.pQueueCreateInfos = queue_create_infos.data();
             ldev_info.pEnabledFeatures = &dev_features;
 
+            // frames are paced with a timeline semaphore, device selection made sure it is there
+            auto timeline_features = FrameScheduler::required_features();
+            ldev_info.pNext = &timeline_features;
+
+            use_bindless_ = bindless_requested_ && BindlessTextures::device_supports(dev_.physical);
+            auto indexing_features = BindlessTextures::required_features();
+            if (use_bindless_) {
+                timeline_features.pNext = &indexing_features;
+            }
+
+            // lets upload batches on a dedicated transfer family be timed, those cannot reset queries themselves
+            host_query_reset_ = GpuProfiler::host_reset_supported(dev_.physical);
+            auto host_reset_features = GpuProfiler::host_reset_features();
+            if (host_query_reset_) {
+                host_reset_features.pNext = timeline_features.pNext;
+                timeline_features.pNext = &host_reset_features;
+            }
+
             auto dev_exts = get_device_extensions();
             ldev_info.enabledExtensionCount = dev_exts.size();
             ldev_info.ppEnabledExtensionNames = dev_exts.data();
@@ -338,9 +663,15 @@ class VulkanRenderer {
 
             vkGetDeviceQueue(dev_.logical, *gfx_queue_idx, 0, &queues_.graphics.queue);
             vkGetDeviceQueue(dev_.logical, *present_queue_idx, 0, &queues_.present.queue);
+            vkGetDeviceQueue(dev_.logical, queues_.transfer.idx, 0, &queues_.transfer.queue);
         }
 
         void create_swapchain() {
+            if (headless()) {
+                create_offscreen_target();
+                return;
+            }
+
             auto sfc_caps = VkSurfaceCapabilitiesKHR{};
             vkGetPhysicalDeviceSurfaceCapabilitiesKHR(dev_.physical, surf_, &sfc_caps);
 
@@ -354,21 +685,25 @@ class VulkanRenderer {
             auto sfc_fmts = std::vector<VkSurfaceFormatKHR>(sfc_fmt_cnt);
             vkGetPhysicalDeviceSurfaceFormatsKHR(dev_.physical, surf_, &sfc_fmt_cnt, sfc_fmts.data());
 
-            uint32_t img_cnt = std::min(sfc_caps.minImageCount+1, std::max(sfc_caps.maxImageCount, UINT32_MAX));
+            auto pres_mode = choose_present_mode(pres_modes, present_policy_);
+            auto sfc_fmt = choose_surface_format(sfc_fmts);
+            auto img_cnt = choose_image_count(sfc_caps, pres_mode);
 
             auto sc_info = VkSwapchainCreateInfoKHR{};
             sc_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-            sc_info.presentMode = pres_modes[0];
+            sc_info.presentMode = pres_mode;
             sc_info.surface = surf_;
             sc_info.minImageCount = img_cnt;
-            sc_info.imageFormat = sfc_fmts[0].format;
-            sc_info.imageColorSpace = sfc_fmts[0].colorSpace;
+            sc_info.imageFormat = sfc_fmt.format;
+            sc_info.imageColorSpace = sfc_fmt.colorSpace;
             sc_info.imageExtent = get_image_extent(sfc_caps);
             sc_info.preTransform = sfc_caps.currentTransform;
             sc_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
             sc_info.imageArrayLayers = 1;
             sc_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
             sc_info.clipped = VK_TRUE;
+            // lets the presentation engine hand over in-flight images, the old swapchain is retired by the caller
+            sc_info.oldSwapchain = swap_chain_;
 
             uint32_t queue_idxs[] = {
                 queues_.graphics.idx,
@@ -391,6 +726,7 @@ class VulkanRenderer {
 
             swapchain_settings_.format = sc_info.imageFormat;
             swapchain_settings_.extent = sc_info.imageExtent;
+            swapchain_settings_.present_mode = sc_info.presentMode;
 
             vkGetSwapchainImagesKHR(dev_.logical, swap_chain_, &img_cnt, nullptr);
             sc_imgs_.resize(img_cnt);
@@ -403,49 +739,148 @@ class VulkanRenderer {
             }
         }
 
+        void create_offscreen_target() {
+            offscreen_.init(dev_, allocator_, offscreen_extent_, offscreen_img_cnt_);
+
+            swapchain_settings_.format = OffscreenTarget::FORMAT;
+            swapchain_settings_.extent = offscreen_.extent();
+
+            sc_imgs_ = offscreen_.images();
+            sc_img_views_.resize(sc_imgs_.size());
+            for (size_t i=0; i<sc_imgs_.size(); ++i) {
+                sc_img_views_[i] = create_image_view(dev_.logical, sc_imgs_[i], swapchain_settings_.format);
+            }
+        }
+
+        DepthTarget create_depth_target() {
+            auto img_desc = ImageDesc{};
+            img_desc.width = swapchain_settings_.extent.width;
+            img_desc.height = swapchain_settings_.extent.height;
+            img_desc.format = depth_format_;
+            img_desc.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+            img_desc.mem_props = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+            auto ret = DepthTarget{};
+            create_image(dev_, allocator_, img_desc, &ret.image, &ret.mem);
+            ret.view = create_image_view(dev_.logical, ret.image, depth_format_, 1, VK_IMAGE_ASPECT_DEPTH_BIT);
+            return ret;
+        }
+
+        void destroy_depth_target(DepthTarget& depth) {
+            if (depth.image == VK_NULL_HANDLE) {
+                return;
+            }
+            vkDestroyImageView(dev_.logical, depth.view, nullptr);
+            destroy_image(dev_, allocator_, depth.image, depth.mem);
+            depth = DepthTarget{};
+        }
+
+        // only the objects that depend on the swapchain images, everything else outlives a resize
         void cleanup_swapchain() {
-            vkFreeCommandBuffers(dev_.logical, command_pool_, static_cast<uint32_t>(command_buffers_.size()), command_buffers_.data());
             for (auto fb : sc_framebuffers_) {
                 vkDestroyFramebuffer(dev_.logical, fb, nullptr);
             }
-            vkDestroyPipeline(dev_.logical, pipeline_, nullptr);
-            vkDestroyPipelineLayout(dev_.logical, pl_layout_, nullptr);
-            vkDestroyRenderPass(dev_.logical, render_pass_, nullptr);
             for (auto img_view : sc_img_views_) {
                 vkDestroyImageView(dev_.logical, img_view, nullptr);
             }
-            vkDestroySwapchainKHR(dev_.logical, swap_chain_, nullptr);
-
-            for (size_t i=0; i<uniform_mems_.size(); ++i) {
-                vkDestroyBuffer(dev_.logical, uniform_buffers_[i], nullptr);
-                vkFreeMemory(dev_.logical, uniform_mems_[i], nullptr);
+            destroy_depth_target(depth_);
+            if (headless()) {
+                offscreen_.destroy(allocator_);
+            } else {
+                vkDestroySwapchainKHR(dev_.logical, swap_chain_, nullptr);
             }
-            vkDestroyDescriptorPool(dev_.logical, desc_pool_, nullptr);
         }
 
+        // Frames still in flight keep using the old objects, so they are
+        // retired with the serial of the last submitted frame and destroyed
+        // once that frame's serial has completed. The render pass and
+        // pipeline only change with the surface format; uniforms and the
+        // descriptor set are per frame in flight and never change.
         void recreate_swapchain() {
-            vkDeviceWaitIdle(dev_.logical);
-
-            cleanup_swapchain();
+            auto sfc_caps = VkSurfaceCapabilitiesKHR{};
+            vkGetPhysicalDeviceSurfaceCapabilitiesKHR(dev_.physical, surf_, &sfc_caps);
+            auto extent = get_image_extent(sfc_caps);
+            if (extent.width == 0 || extent.height == 0) {
+                // minimized, try again on the next frame
+                return;
+            }
 
+            auto retired = RetiredSwapchain{};
+            retired.serial = scheduler_.submitted();
+            retired.swapchain = swap_chain_;
+            retired.views = std::move(sc_img_views_);
+            retired.framebuffers = std::move(sc_framebuffers_);
+            retired.depth = std::exchange(depth_, DepthTarget{});
+            sc_img_views_.clear();
+            sc_framebuffers_.clear();
+
+            auto old_format = swapchain_settings_.format;
+            auto old_img_cnt = sc_imgs_.size();
             create_swapchain();
-            create_render_pass();
-            create_gfx_pipeline();
+            depth_ = create_depth_target();
+
+            if (swapchain_settings_.format != old_format) {
+                retired.render_pass = render_pass_;
+                retired.pipeline = pipeline_;
+                create_render_pass();
+                create_gfx_pipeline();
+            }
+            if (sc_imgs_.size() != old_img_cnt) {
+                image_serial_.assign(sc_imgs_.size(), 0);
+            }
             create_framebuffers();
-            create_uniform_buffers();
-            create_desc_pool();
-            create_desc_sets();
-            create_command_buffers();
+            retired_.push_back(std::move(retired));
 
             window_resized_ = false;
         }
 
-        void create_gfx_pipeline() {
-            auto frag_shdr_code = load_file("frag.spv");
-            auto vert_shdr_code = load_file("vert.spv");
+        // everything retired before the last completed frame, or all of it once the device is idle
+        void release_retired(bool all) {
+            while (!retired_.empty() && (all || scheduler_.is_complete(retired_.front().serial))) {
+                auto& retired = retired_.front();
+                for (auto fb : retired.framebuffers) {
+                    vkDestroyFramebuffer(dev_.logical, fb, nullptr);
+                }
+                for (auto img_view : retired.views) {
+                    vkDestroyImageView(dev_.logical, img_view, nullptr);
+                }
+                vkDestroySwapchainKHR(dev_.logical, retired.swapchain, nullptr);
+                destroy_depth_target(retired.depth);
+                if (retired.pipeline != VK_NULL_HANDLE) {
+                    vkDestroyPipeline(dev_.logical, retired.pipeline, nullptr);
+                    vkDestroyRenderPass(dev_.logical, retired.render_pass, nullptr);
+                }
+                retired_.pop_front();
+            }
+        }
+
+        void create_pipeline_layout() {
+            auto pl_layout_info = VkPipelineLayoutCreateInfo{};
+            pl_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+            // the bindless texture array is a set of its own, update-after-bind sets can't hold dynamic uniforms
+            VkDescriptorSetLayout set_layouts[] = {desc_set_layout_, use_bindless_ ? bindless_.layout() : VK_NULL_HANDLE};
+            pl_layout_info.setLayoutCount = use_bindless_ ? 2 : 1;
+            pl_layout_info.pSetLayouts = set_layouts;
+
+            // per-draw transforms, 64 bytes are well within the guaranteed 128
+            auto push_range = VkPushConstantRange{};
+            push_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+            push_range.offset = 0;
+            push_range.size = sizeof(DrawPushConstants);
+            pl_layout_info.pushConstantRangeCount = 1;
+            pl_layout_info.pPushConstantRanges = &push_range;
+
+            {
+                auto res = vkCreatePipelineLayout(dev_.logical, &pl_layout_info, nullptr, &pl_layout_);
+                if (res != VK_SUCCESS) {
+                    throw VulkanError("Error creating PipelineLayout", res);
+                }
+            }
+        }
 
-            auto frag_shdr = create_shader_module(dev_.logical, frag_shdr_code.data(), frag_shdr_code.size());
-            auto vert_shdr = create_shader_module(dev_.logical, vert_shdr_code.data(), vert_shdr_code.size());
+        void create_gfx_pipeline() {
+            auto frag_shdr = create_shader_module(dev_.logical, load_file(use_bindless_ ? "frag_bindless.spv" : "frag.spv").bytes());
+            auto vert_shdr = create_shader_module(dev_.logical, load_file("vert.spv").bytes());
 
             auto pl_vert_info = VkPipelineShaderStageCreateInfo{};
             pl_vert_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -461,13 +896,22 @@ class VulkanRenderer {
 
             VkPipelineShaderStageCreateInfo shader_stages[] = { pl_vert_info, pl_frag_info };
 
-            auto vert_binding_desc = Vertex::get_binding_desc();
-            auto vert_attrib_desc = Vertex::get_attrib_desc();
+            auto vert_binding_desc = std::array<VkVertexInputBindingDescription, 2>{
+                Vertex::get_binding_desc(mesh_vertex_format_),
+                InstanceData::get_binding_desc(),
+            };
+            auto vert_attrib_desc = std::vector<VkVertexInputAttributeDescription>{};
+            for (const auto& attrib : Vertex::get_attrib_desc(mesh_vertex_format_)) {
+                vert_attrib_desc.push_back(attrib);
+            }
+            for (const auto& attrib : InstanceData::get_attrib_desc()) {
+                vert_attrib_desc.push_back(attrib);
+            }
 
             auto vert_input_info = VkPipelineVertexInputStateCreateInfo{};
             vert_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-            vert_input_info.vertexBindingDescriptionCount = 1;
-            vert_input_info.pVertexBindingDescriptions = &vert_binding_desc;
+            vert_input_info.vertexBindingDescriptionCount = static_cast<uint32_t>(vert_binding_desc.size());
+            vert_input_info.pVertexBindingDescriptions = vert_binding_desc.data();
             vert_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(vert_attrib_desc.size());
             vert_input_info.pVertexAttributeDescriptions = vert_attrib_desc.data();
 
@@ -476,24 +920,13 @@ class VulkanRenderer {
             input_assembly_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
             input_assembly_info.primitiveRestartEnable = VK_FALSE;
 
-            auto viewport = VkViewport{};
-            viewport.x = 0.0f;
-            viewport.y = 0.0f;
-            viewport.width = static_cast<float>(swapchain_settings_.extent.width);
-            viewport.height = static_cast<float>(swapchain_settings_.extent.height);
-            viewport.minDepth = 0.0f;
-            viewport.maxDepth = 1.0f;
-
-            auto scissor = VkRect2D{};
-            scissor.offset = VkOffset2D{0, 0};
-            scissor.extent = swapchain_settings_.extent;
-
+            // viewport and scissor are dynamic, so the pipeline does not depend on the swapchain extent
             auto viewport_info = VkPipelineViewportStateCreateInfo{};
             viewport_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
             viewport_info.viewportCount = 1;
-            viewport_info.pViewports = &viewport;
+            viewport_info.pViewports = nullptr;
             viewport_info.scissorCount = 1;
-            viewport_info.pScissors = &scissor;
+            viewport_info.pScissors = nullptr;
 
             auto rasterizer_info = VkPipelineRasterizationStateCreateInfo{};
             rasterizer_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -525,27 +958,24 @@ class VulkanRenderer {
             blend_global_info.pAttachments = &blend_attachment_info;
             blend_global_info.logicOpEnable = VK_FALSE;
 
+            // opaque draws arrive front to back, so most hidden fragments fail the test before shading
+            auto depth_info = VkPipelineDepthStencilStateCreateInfo{};
+            depth_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+            depth_info.depthTestEnable = VK_TRUE;
+            depth_info.depthWriteEnable = VK_TRUE;
+            depth_info.depthCompareOp = VK_COMPARE_OP_LESS;
+            depth_info.depthBoundsTestEnable = VK_FALSE;
+            depth_info.stencilTestEnable = VK_FALSE;
+
             VkDynamicState dyn_states[] = {
                 VkDynamicState::VK_DYNAMIC_STATE_VIEWPORT,
-                VkDynamicState::VK_DYNAMIC_STATE_LINE_WIDTH,
+                VkDynamicState::VK_DYNAMIC_STATE_SCISSOR,
             };
             auto dyn_state_info = VkPipelineDynamicStateCreateInfo{};
             dyn_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
             dyn_state_info.dynamicStateCount = sizeof(dyn_states) / sizeof(dyn_states[0]);
             dyn_state_info.pDynamicStates = dyn_states;
 
-            auto pl_layout_info = VkPipelineLayoutCreateInfo{};
-            pl_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-            pl_layout_info.setLayoutCount = 1;
-            pl_layout_info.pSetLayouts = &desc_set_layout_;
-
-            {
-                auto res = vkCreatePipelineLayout(dev_.logical, &pl_layout_info, nullptr, &pl_layout_);
-                if (res != VK_SUCCESS) {
-                    throw VulkanError("Error creating PipelineLayout", res);
-                }
-            }
-
             auto pl_info = VkGraphicsPipelineCreateInfo{};
             pl_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
             pl_info.stageCount = 2;
@@ -555,9 +985,9 @@ class VulkanRenderer {
             pl_info.pViewportState = &viewport_info;
             pl_info.pRasterizationState = &rasterizer_info;
             pl_info.pMultisampleState = &ms_info;
-            pl_info.pDepthStencilState = nullptr;
+            pl_info.pDepthStencilState = &depth_info;
             pl_info.pColorBlendState = &blend_global_info;
-            pl_info.pDynamicState = nullptr;
+            pl_info.pDynamicState = &dyn_state_info;
             pl_info.layout = pl_layout_;
             pl_info.renderPass = render_pass_;
             pl_info.subpass = 0;
@@ -565,7 +995,7 @@ class VulkanRenderer {
             pl_info.basePipelineIndex = -1;
 
             {
-                auto res = vkCreateGraphicsPipelines(dev_.logical, VK_NULL_HANDLE, 1, &pl_info, nullptr, &pipeline_);
+                auto res = vkCreateGraphicsPipelines(dev_.logical, pipeline_cache_, 1, &pl_info, nullptr, &pipeline_);
                 if (res != VK_SUCCESS) {
                     vkDestroyShaderModule(dev_.logical, frag_shdr, nullptr);
                     vkDestroyShaderModule(dev_.logical, vert_shdr, nullptr);
@@ -583,6 +1013,7 @@ class VulkanRenderer {
             for (size_t i=0; i<sc_img_views_.size(); ++i) {
                 VkImageView attached[] = {
                     sc_img_views_[i],
+                    depth_.view,
                 };
 
                 auto fb_info = VkFramebufferCreateInfo{};
@@ -603,280 +1034,499 @@ class VulkanRenderer {
             }
         }
 
-        void create_command_pool() {
+        void create_frame_resources() {
+            frames_.resize(frames_in_flight_);
+            for (auto& frame : frames_) {
+                // reset as a whole every frame, the command buffers are recorded again each time
+                frame.cmd_pool = create_transient_pool();
+                frame.cmd_buf = allocate_cmd_buf(frame.cmd_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+                frame.descriptors.init(dev_);
+
+                // a pool is only ever touched by the thread recording into it
+                if (jobs_.worker_count() > 1) {
+                    frame.workers.resize(jobs_.worker_count());
+                    for (auto& worker : frame.workers) {
+                        worker.cmd_pool = create_transient_pool();
+                        worker.cmd_buf = allocate_cmd_buf(worker.cmd_pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+                    }
+                }
+            }
+        }
+
+        VkCommandPool create_transient_pool() {
             auto pool_info = VkCommandPoolCreateInfo{};
             pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
             pool_info.queueFamilyIndex = queues_.graphics.idx;
-            pool_info.flags = 0;
+            pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            VkCommandPool ret;
+            if (auto res = vkCreateCommandPool(dev_.logical, &pool_info, nullptr, &ret); res != VK_SUCCESS) {
+                throw VulkanError("Error creating CommandPool", res);
+            }
+            return ret;
+        }
 
-            {
-                auto res = vkCreateCommandPool(dev_.logical, &pool_info, nullptr, &command_pool_);
-                if (res != VK_SUCCESS) {
-                    throw VulkanError("Error creating CommandPool", res);
+        VkCommandBuffer allocate_cmd_buf(VkCommandPool pool, VkCommandBufferLevel level) {
+            auto buffer_info = VkCommandBufferAllocateInfo{};
+            buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            buffer_info.level = level;
+            buffer_info.commandPool = pool;
+            buffer_info.commandBufferCount = 1;
+            VkCommandBuffer ret;
+            if (auto res = vkAllocateCommandBuffers(dev_.logical, &buffer_info, &ret); res != VK_SUCCESS) {
+                throw VulkanError("Error creating CommandBuffers", res);
+            }
+            return ret;
+        }
+
+        void destroy_frame_resources() {
+            for (auto& frame : frames_) {
+                if (frame.instance_buffer != VK_NULL_HANDLE) {
+                    destroy_buffer(dev_, allocator_, frame.instance_buffer, frame.instance_mem);
                 }
+                for (auto& worker : frame.workers) {
+                    vkDestroyCommandPool(dev_.logical, worker.cmd_pool, nullptr);
+                }
+                vkDestroyCommandPool(dev_.logical, frame.cmd_pool, nullptr);
+                frame.descriptors.destroy();
             }
+            frames_.clear();
         }
 
-        void create_tex_image() {
-            auto tex = Texture("texture.jpg");
+        // the frame's previous use has completed, so its instance buffer can be replaced
+        void reserve_instances(FrameResources& frame) {
+            if (instances_.size() <= frame.instance_capacity) {
+                return;
+            }
+            if (frame.instance_buffer != VK_NULL_HANDLE) {
+                destroy_buffer(dev_, allocator_, frame.instance_buffer, frame.instance_mem);
+            }
+            frame.instance_capacity = std::max(instances_.size(), 2 * frame.instance_capacity);
 
             auto buf_desc = BufferDesc{};
-            buf_desc.size = tex.size();
-            buf_desc.buf_usage_flags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+            buf_desc.size = frame.instance_capacity * sizeof(InstanceData);
+            buf_desc.buf_usage_flags = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
             buf_desc.mem_prop_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+            create_buffer(dev_, allocator_, buf_desc, &frame.instance_buffer, &frame.instance_mem);
+            if (gpu_culling_) {
+                culler_.reserve(allocator_, curr_frame_, frame.instance_capacity);
+            }
+        }
 
-            auto staging_buf = VkBuffer{};
-            auto staging_mem = VkDeviceMemory{};
-            create_buffer(dev_, buf_desc, &staging_buf, &staging_mem);
+        void record_frame(FrameResources& frame, uint32_t img_idx) {
+            auto cmd_buf = frame.cmd_buf;
+            reserve_instances(frame);
+            sort_instances(frame);
 
-            void* data = nullptr;
-            vkMapMemory(dev_.logical, staging_mem, 0, buf_desc.size, 0, &data);
-            std::memcpy(data, tex.data(), static_cast<size_t>(buf_desc.size));
-            vkUnmapMemory(dev_.logical, staging_mem);
+            auto begin_info = VkCommandBufferBeginInfo{};
+            begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            if (auto res = vkBeginCommandBuffer(cmd_buf, &begin_info); res != VK_SUCCESS) {
+                throw VulkanError("Error begin CommandBuffer recording", res);
+            }
 
-            auto img_desc = ImageDesc{};
-            img_desc.width = tex.width();
-            img_desc.height = tex.height();
-            img_desc.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-            img_desc.mem_props = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-            create_image(dev_, img_desc, &tex_image_, &tex_mem_);
+            auto slot = static_cast<uint32_t>(curr_frame_);
+            profiler_.begin(cmd_buf, slot);
+            auto frame_query = profiler_.begin_scope(cmd_buf, slot, "frame");
+
+            auto culled = gpu_culling_ && !instances_.empty();
+            if (culled) {
+                copy_instances(frame);
+                auto timing = profiler_.scope(cmd_buf, slot, "cull");
+                culler_.record(
+                    cmd_buf, curr_frame_, frame.descriptors, frame.instance_buffer, frame.draw_constants.mvp,
+                    mesh_index_count_, static_cast<uint32_t>(instances_.size())
+                );
+            }
 
             {
-                auto cmd_buf = OneTimeCommandBuffer(dev_.logical, command_pool_);
-                auto cmd_executor = RAIICommandBufferExecutor(cmd_buf, queues_.graphics.queue);
-                transition_image_layout(cmd_buf, tex_image_, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-                copy_buffer_to_image(cmd_buf, staging_buf, tex_image_, tex.extent());
-                transition_image_layout(cmd_buf, tex_image_, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+                auto timing = profiler_.scope(cmd_buf, slot, "render_pass");
+                auto parallel = !culled && !frame.workers.empty();
+                auto rp_begin_info = VkRenderPassBeginInfo{};
+                rp_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+                rp_begin_info.framebuffer = sc_framebuffers_[img_idx];
+                rp_begin_info.renderPass = render_pass_;
+                rp_begin_info.renderArea.offset = VkOffset2D{0, 0};
+                rp_begin_info.renderArea.extent = swapchain_settings_.extent;
+                auto clear_values = std::array<VkClearValue, 2>{};
+                clear_values[0].color = VkClearColorValue{{0.0f, 0.0f, 0.0f, 1.0f}};
+                clear_values[1].depthStencil = VkClearDepthStencilValue{1.0f, 0};
+                rp_begin_info.clearValueCount = static_cast<uint32_t>(clear_values.size());
+                rp_begin_info.pClearValues = clear_values.data();
+                vkCmdBeginRenderPass(
+                    cmd_buf, &rp_begin_info,
+                    parallel ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE
+                );
+
+                if (culled) {
+                    record_culled_draw(cmd_buf, frame);
+                } else if (parallel) {
+                    record_secondaries(frame, img_idx);
+                    auto secondaries = std::vector<VkCommandBuffer>{};
+                    for (const auto& worker : frame.workers) {
+                        secondaries.push_back(worker.cmd_buf);
+                    }
+                    vkCmdExecuteCommands(cmd_buf, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+                } else {
+                    write_instances(frame, 0, instances_.size());
+                    record_draws(cmd_buf, frame, 0, instances_.size());
+                }
+
+                vkCmdEndRenderPass(cmd_buf);
             }
 
-            vkFreeMemory(dev_.logical, staging_mem, nullptr);
-            vkDestroyBuffer(dev_.logical, staging_buf, nullptr);
+            if (headless()) {
+                offscreen_.record_readback(cmd_buf, img_idx);
+            }
+            profiler_.end_scope(cmd_buf, frame_query);
 
-            tex_image_view_ = create_image_view(dev_.logical, tex_image_, VK_FORMAT_R8G8B8A8_SRGB);
+            if (auto res = vkEndCommandBuffer(cmd_buf); res != VK_SUCCESS) {
+                throw VulkanError("Error ending CommandBuffer recording", res);
+            }
         }
 
-        void create_vert_buffer() {
-            auto buf_desc = BufferDesc{};
-            buf_desc.size = vertices.size() * sizeof(vertices[0]);
-            buf_desc.buf_usage_flags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-            buf_desc.mem_prop_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        // every worker copies and draws a contiguous share of the instances into its own secondary buffer
+        void record_secondaries(FrameResources& frame, uint32_t img_idx) {
+            auto worker_cnt = frame.workers.size();
+            auto per_worker = (instances_.size() + worker_cnt - 1) / worker_cnt;
 
-            auto staging_buf = VkBuffer{};
-            auto staging_mem = VkDeviceMemory{};
-            create_buffer(dev_, buf_desc, &staging_buf, &staging_mem);
+            jobs_.run([&, this](uint32_t w) {
+                auto& worker = frame.workers[w];
+                auto first = std::min(w * per_worker, instances_.size());
+                auto count = std::min(per_worker, instances_.size() - first);
 
-            void* data = nullptr;
-            vkMapMemory(dev_.logical, staging_mem, 0, buf_desc.size, 0, &data);
-            std::memcpy(data, vertices.data(), static_cast<size_t>(buf_desc.size));
-            vkUnmapMemory(dev_.logical, staging_mem);
+                if (auto res = vkResetCommandPool(dev_.logical, worker.cmd_pool, 0); res != VK_SUCCESS) {
+                    throw VulkanError("Error resetting CommandPool", res);
+                }
 
-            buf_desc.buf_usage_flags = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-            buf_desc.mem_prop_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-            create_buffer(dev_, buf_desc, &vert_buffer_, &vert_mem_);
-            copy_buffer(dev_, queues_.graphics.queue, command_pool_, staging_buf, vert_buffer_, buf_desc.size);
+                auto inherit_info = VkCommandBufferInheritanceInfo{};
+                inherit_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+                inherit_info.renderPass = render_pass_;
+                inherit_info.subpass = 0;
+                inherit_info.framebuffer = sc_framebuffers_[img_idx];
+
+                auto begin_info = VkCommandBufferBeginInfo{};
+                begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+                begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+                begin_info.pInheritanceInfo = &inherit_info;
+                if (auto res = vkBeginCommandBuffer(worker.cmd_buf, &begin_info); res != VK_SUCCESS) {
+                    throw VulkanError("Error begin CommandBuffer recording", res);
+                }
 
-            vkFreeMemory(dev_.logical, staging_mem, nullptr);
-            vkDestroyBuffer(dev_.logical, staging_buf, nullptr);
+                write_instances(frame, first, count);
+                record_draws(worker.cmd_buf, frame, first, count);
+
+                if (auto res = vkEndCommandBuffer(worker.cmd_buf); res != VK_SUCCESS) {
+                    throw VulkanError("Error ending CommandBuffer recording", res);
+                }
+            });
         }
 
-        void create_idx_buffer() {
-            auto buf_desc = BufferDesc{};
-            buf_desc.size = indices.size() * sizeof(indices[0]);
-            buf_desc.buf_usage_flags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-            buf_desc.mem_prop_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        // all instances, split across the recording workers when there are several
+        void copy_instances(FrameResources& frame) {
+            if (frame.workers.empty()) {
+                write_instances(frame, 0, instances_.size());
+                return;
+            }
+            auto worker_cnt = frame.workers.size();
+            auto per_worker = (instances_.size() + worker_cnt - 1) / worker_cnt;
+            jobs_.run([&, this](uint32_t w) {
+                auto first = std::min(w * per_worker, instances_.size());
+                write_instances(frame, first, std::min(per_worker, instances_.size() - first));
+            });
+        }
 
-            auto staging_buf = VkBuffer{};
-            auto staging_mem = VkDeviceMemory{};
-            create_buffer(dev_, buf_desc, &staging_buf, &staging_mem);
+        // front to back by each instance's origin, which the mesh is centered on
+        void sort_instances(const FrameResources& frame) {
+            opaque_queue_.clear();
+            if (!sort_draws_) {
+                return;
+            }
+            opaque_queue_.reserve(instances_.size());
+            for (uint32_t i=0; i<instances_.size(); ++i) {
+                // clip space w is the distance along the view direction under a perspective projection
+                auto depth = (frame.draw_constants.mvp * instances_[i].model[3]).w;
+                // bindless materials share one bind, grouping by them would only break up the depth order
+                auto material = use_bindless_ ? 0u : instances_[i].texture;
+                opaque_queue_.push(SortKey::opaque(0, material, depth), i);
+            }
+            opaque_queue_.sort();
+        }
 
-            void* data = nullptr;
-            vkMapMemory(dev_.logical, staging_mem, 0, buf_desc.size, 0, &data);
-            std::memcpy(data, indices.data(), static_cast<size_t>(buf_desc.size));
-            vkUnmapMemory(dev_.logical, staging_mem);
+        void write_instances(FrameResources& frame, size_t first, size_t count) {
+            if (count == 0) {
+                return;
+            }
+            auto dst = static_cast<InstanceData*>(frame.instance_mem.mapped) + first;
+            if (opaque_queue_.size() == 0) {
+                std::memcpy(dst, instances_.data() + first, count * sizeof(InstanceData));
+                return;
+            }
+            const auto& order = opaque_queue_.entries();
+            for (size_t i=0; i<count; ++i) {
+                dst[i] = instances_[order[first + i].item];
+            }
+        }
 
-            buf_desc.buf_usage_flags = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
-            buf_desc.mem_prop_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-            create_buffer(dev_, buf_desc, &idx_buffer_, &idx_mem_);
-            copy_buffer(dev_, queues_.graphics.queue, command_pool_, staging_buf, idx_buffer_, buf_desc.size);
+        void record_draws(VkCommandBuffer cmd_buf, const FrameResources& frame, size_t first, size_t count) {
+            if (count == 0) {
+                return;
+            }
+            bind_draw_state(cmd_buf, frame, frame.instance_buffer);
+            vkCmdDrawIndexed(
+                cmd_buf, mesh_index_count_, static_cast<uint32_t>(count),
+                0, 0, static_cast<uint32_t>(first)
+            );
+        }
 
-            vkFreeMemory(dev_.logical, staging_mem, nullptr);
-            vkDestroyBuffer(dev_.logical, staging_buf, nullptr);
+        // the instance count was written by the culling pass
+        void record_culled_draw(VkCommandBuffer cmd_buf, const FrameResources& frame) {
+            bind_draw_state(cmd_buf, frame, culler_.visible_buffer(curr_frame_));
+            vkCmdDrawIndexedIndirect(cmd_buf, culler_.indirect_buffer(curr_frame_), 0, 1, sizeof(VkDrawIndexedIndirectCommand));
         }
 
-        void create_uniform_buffers() {
-            auto buf_desc = BufferDesc{};
-            buf_desc.size = sizeof(UniformBufferObject);
-            buf_desc.buf_usage_flags = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-            buf_desc.mem_prop_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        // state is not inherited by secondary buffers, so each records the full set
+        void bind_draw_state(VkCommandBuffer cmd_buf, const FrameResources& frame, VkBuffer instances) {
+            vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_);
 
-            uniform_buffers_.resize(sc_imgs_.size());
-            uniform_mems_.resize(sc_imgs_.size());
+            auto viewport = VkViewport{};
+            viewport.x = 0.0f;
+            viewport.y = 0.0f;
+            viewport.width = static_cast<float>(swapchain_settings_.extent.width);
+            viewport.height = static_cast<float>(swapchain_settings_.extent.height);
+            viewport.minDepth = 0.0f;
+            viewport.maxDepth = 1.0f;
+            vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
 
-            for (size_t i=0; i<sc_imgs_.size(); ++i) {
-                create_buffer(dev_, buf_desc, &uniform_buffers_[i], &uniform_mems_[i]);
+            auto scissor = VkRect2D{};
+            scissor.offset = VkOffset2D{0, 0};
+            scissor.extent = swapchain_settings_.extent;
+            vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
+
+            VkBuffer buffers[] = {vert_buffer_, instances};
+            VkDeviceSize offsets[] = {0, 0};
+            vkCmdBindVertexBuffers(cmd_buf, 0, 2, buffers, offsets);
+            vkCmdBindIndexBuffer(cmd_buf, idx_buffer_, 0, mesh_index_type_);
+            vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pl_layout_, 0, 1, &desc_set_, 1, &frame.ubo_offset);
+            if (use_bindless_) {
+                vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pl_layout_, 1, 1, &bindless_.set(), 0, nullptr);
             }
+            vkCmdPushConstants(cmd_buf, pl_layout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawPushConstants), &frame.draw_constants);
         }
 
-        void create_desc_pool() {
-            auto pool_size = std::array<VkDescriptorPoolSize,2>{};
-            pool_size[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            pool_size[0].descriptorCount = static_cast<uint32_t>(sc_imgs_.size());
-            pool_size[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            pool_size[1].descriptorCount = static_cast<uint32_t>(sc_imgs_.size());
-
-            auto desc_pool_info = VkDescriptorPoolCreateInfo{};
-            desc_pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-            desc_pool_info.poolSizeCount = static_cast<uint32_t>(pool_size.size());
-            desc_pool_info.pPoolSizes = pool_size.data();
-            desc_pool_info.maxSets = static_cast<uint32_t>(sc_imgs_.size());
+        bool graphics_supports_compute() const {
+            uint32_t qfam_cnt;
+            vkGetPhysicalDeviceQueueFamilyProperties(dev_.physical, &qfam_cnt, nullptr);
+            auto qfams = std::vector<VkQueueFamilyProperties>(qfam_cnt);
+            vkGetPhysicalDeviceQueueFamilyProperties(dev_.physical, &qfam_cnt, qfams.data());
+            return (qfams[queues_.graphics.idx].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+        }
 
-            {
-                auto res = vkCreateDescriptorPool(dev_.logical, &desc_pool_info, nullptr, &desc_pool_);
-                if (res != VK_SUCCESS) {
-                    throw VulkanError("Error creating DescriptorPool", res);
+        // the first cooked texture the device can sample, tried best quality first, else the source image;
+        // only the headers are read here, the mapping is dropped again
+        std::filesystem::path pick_texture_file() const {
+            for (auto fpath : {"texture.bc7.dds", "texture.bc3.dds", "texture.bc1.dds"}) {
+                if (!std::filesystem::exists(fpath)) {
+                    continue;
+                }
+                if (CompressedTexture::device_supports(dev_.physical, CompressedTexture::load(fpath).format())) {
+                    return fpath;
                 }
             }
+            return "texture.jpg";
         }
 
-        void create_desc_sets() {
-            auto layouts = std::vector<VkDescriptorSetLayout>(sc_imgs_.size(), desc_set_layout_);
-            desc_sets_.resize(sc_imgs_.size());
+        TextureImage create_texture(const Texture& tex) {
+            auto img_desc = ImageDesc{};
+            img_desc.width = tex.width();
+            img_desc.height = tex.height();
+            img_desc.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+            img_desc.mem_props = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+            img_desc.mip_levels = mip_level_count(tex.width(), tex.height());
+
+            auto ret = TextureImage{};
+            create_image(dev_, allocator_, img_desc, &ret.image, &ret.mem);
+            uploads_.upload_image(ret.image, tex.data(), tex.width(), tex.height(), img_desc.mip_levels);
+            ret.format = img_desc.format;
+            ret.mip_levels = img_desc.mip_levels;
+            ret.view = create_image_view(dev_.logical, ret.image, ret.format, ret.mip_levels);
+            return ret;
+        }
 
-            auto desc_set_info = VkDescriptorSetAllocateInfo{};
-            desc_set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-            desc_set_info.descriptorPool = desc_pool_;
-            desc_set_info.descriptorSetCount = static_cast<uint32_t>(sc_imgs_.size());
-            desc_set_info.pSetLayouts = layouts.data();
-            {
-                auto res = vkAllocateDescriptorSets(dev_.logical, &desc_set_info, desc_sets_.data());
-                if (res != VK_SUCCESS) {
-                    throw VulkanError("Error creating DescriptorSets", res);
+        // generated textures are uploaded right away; a file is streamed in and replaces a small
+        // placeholder checkerboard once it is resident
+        void create_tex_image() {
+            if (scene_.texture_size == 0) {
+                textures_.push_back(create_texture(Texture::checkerboard(PLACEHOLDER_TEXTURE_SIZE)));
+            } else {
+                auto count = use_bindless_ ? std::max(scene_.texture_count, 1u) : 1u;
+                for (uint32_t i=0; i<count; ++i) {
+                    textures_.push_back(create_texture(Texture::checkerboard(scene_.texture_size, 8 + i)));
                 }
             }
-
-            for (size_t i=0; i<sc_imgs_.size(); ++i) {
-                auto buf_info = VkDescriptorBufferInfo{};
-                buf_info.buffer = uniform_buffers_[i];
-                buf_info.offset = 0;
-                buf_info.range = sizeof(UniformBufferObject);
-
-                auto img_info = VkDescriptorImageInfo{};
-                img_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-                img_info.imageView = tex_image_view_;
-                img_info.sampler = tex_sampler_;
-
-                auto desc_write = std::array<VkWriteDescriptorSet,2>{};
-                desc_write[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-                desc_write[0].dstSet = desc_sets_[i];
-                desc_write[0].dstBinding = 0;
-                desc_write[0].dstArrayElement = 0;
-                desc_write[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-                desc_write[0].descriptorCount = 1;
-                desc_write[0].pBufferInfo = &buf_info;
-
-                desc_write[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-                desc_write[1].dstSet = desc_sets_[i];
-                desc_write[1].dstBinding = 1;
-                desc_write[1].dstArrayElement = 0;
-                desc_write[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-                desc_write[1].descriptorCount = 1;
-                desc_write[1].pImageInfo = &img_info;
-
-                vkUpdateDescriptorSets(dev_.logical, static_cast<uint32_t>(desc_write.size()), desc_write.data(), 0, nullptr);
-            }
-        }
-
-        void create_command_buffers() {
-            command_buffers_.resize(sc_framebuffers_.size());
-            auto buffer_info = VkCommandBufferAllocateInfo{};
-            buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-            buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-            buffer_info.commandPool = command_pool_;
-            buffer_info.commandBufferCount = static_cast<uint32_t>(command_buffers_.size());
-
-            {
-                auto res = vkAllocateCommandBuffers(dev_.logical, &buffer_info, command_buffers_.data());
-                if (res != VK_SUCCESS) {
-                    throw VulkanError("Error creating CommandBuffers", res);
+            if (use_bindless_) {
+                for (const auto& tex : textures_) {
+                    texture_slots_.push_back(bindless_.add(tex.view, tex_sampler_));
                 }
             }
 
-            auto begin_info = VkCommandBufferBeginInfo{};
-            begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-            begin_info.pInheritanceInfo = nullptr;
-            begin_info.flags = 0;
-            for (size_t i=0; i<command_buffers_.size(); ++i) {
-                {
-                    auto res = vkBeginCommandBuffer(command_buffers_[i], &begin_info);
-                    if (res != VK_SUCCESS)
-                    {
-                        throw VulkanError("Error begin CommandBuffer recording", res);
+            if (scene_.texture_size == 0) {
+                streamer_.request(pick_texture_file(), [this](TextureId, const TextureImage& streamed) {
+                    if (!use_bindless_) {
+                        // frames already recorded keep the placeholder's set, the switch needs no wait
+                        desc_set_ = create_desc_set(streamed.view);
+                        return;
                     }
-                }
-
-                auto rp_begin_info = VkRenderPassBeginInfo{};
-                rp_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-                rp_begin_info.framebuffer = sc_framebuffers_[i];
-                rp_begin_info.renderPass = render_pass_;
-                rp_begin_info.renderArea.offset = VkOffset2D{0, 0};
-                rp_begin_info.renderArea.extent = swapchain_settings_.extent;
-                auto clear_color = VkClearValue{0.0f, 0.0f, 0.0f, 1.0f};
-                rp_begin_info.clearValueCount = 1;
-                rp_begin_info.pClearValues = &clear_color;
-                vkCmdBeginRenderPass(command_buffers_[i], &rp_begin_info, VK_SUBPASS_CONTENTS_INLINE);
-
-                vkCmdBindPipeline(command_buffers_[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_);
-                VkBuffer buffers[] = {vert_buffer_};
-                VkDeviceSize offsets[] = {0};
-                vkCmdBindVertexBuffers(command_buffers_[i], 0, 1, buffers, offsets);
-                vkCmdBindIndexBuffer(command_buffers_[i], idx_buffer_, 0, VK_INDEX_TYPE_UINT16);
-                vkCmdBindDescriptorSets(command_buffers_[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pl_layout_, 0, 1, &desc_sets_[i], 0, nullptr);
-                vkCmdDrawIndexed(command_buffers_[i], static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
-
-                vkCmdEndRenderPass(command_buffers_[i]);
-                {
-                    auto res = vkEndCommandBuffer(command_buffers_[i]);
-                    if (res != VK_SUCCESS)
-                    {
-                        throw VulkanError("Error begin CommandBuffer recording", res);
+                    // frames already submitted still sample the placeholder's slot
+                    auto slot = bindless_.add(streamed.view, tex_sampler_);
+                    for (auto& instance : instances_) {
+                        if (instance.texture == texture_slots_.front()) {
+                            instance.texture = slot;
+                        }
                     }
-                }
+                    bindless_.remove(texture_slots_.front(), scheduler_.submitted());
+                    texture_slots_.front() = slot;
+                });
             }
         }
 
-        void create_semaphores() {
-            image_available_.resize(MAX_FRAMES_IN_FLIGHT);
-            render_finished_.resize(MAX_FRAMES_IN_FLIGHT);
-            frame_done_.resize(MAX_FRAMES_IN_FLIGHT);
-            frame_in_flight_.resize(sc_imgs_.size(), VK_NULL_HANDLE);
+        void create_vert_buffer(const Mesh& mesh) {
+            auto buf_desc = BufferDesc{};
+            buf_desc.size = mesh.vertex_bytes().size();
+            buf_desc.buf_usage_flags = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+            buf_desc.mem_prop_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+            create_buffer(dev_, allocator_, buf_desc, &vert_buffer_, &vert_mem_);
 
-            auto sema_info = VkSemaphoreCreateInfo{};
-            sema_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+            uploads_.upload_buffer(
+                vert_buffer_, 0, mesh.vertex_bytes().data(), buf_desc.size,
+                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT
+            );
+        }
 
-            auto fence_info = VkFenceCreateInfo{};
-            fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-            fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+        void create_idx_buffer(const Mesh& mesh) {
+            auto buf_desc = BufferDesc{};
+            buf_desc.size = mesh.index_bytes().size();
+            buf_desc.buf_usage_flags = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+            buf_desc.mem_prop_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+            create_buffer(dev_, allocator_, buf_desc, &idx_buffer_, &idx_mem_);
 
-            for (size_t i=0; i<MAX_FRAMES_IN_FLIGHT; ++i) {
-                {
-                    auto res = vkCreateSemaphore(dev_.logical, &sema_info, nullptr, &image_available_[i]);
-                    if (res != VK_SUCCESS) {
-                        throw VulkanError("Error creating Semaphore", res);
-                    }
+            uploads_.upload_buffer(
+                idx_buffer_, 0, mesh.index_bytes().data(), buf_desc.size,
+                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT
+            );
+        }
+
+        // spends the wait for the frame limit on frames in flight first, so their latency is taken when they
+        // complete rather than when the limiter wakes up; the limiter then sleeps whatever is left
+        void observe_completion() {
+            latency_.collect(scheduler_.completed());
+            while (latency_.oldest_pending() != 0 && !limiter_.ready()) {
+                if (!scheduler_.wait_until(latency_.oldest_pending(), limiter_.due())) {
+                    break;
                 }
-                {
-                    auto res = vkCreateSemaphore(dev_.logical, &sema_info, nullptr, &render_finished_[i]);
-                    if (res != VK_SUCCESS) {
-                        throw VulkanError("Error creating Semaphore", res);
-                    }
+                latency_.collect(scheduler_.completed());
+            }
+        }
+
+        void begin_input() {
+            latency_.collect(scheduler_.completed());
+            input_time_ = std::chrono::steady_clock::now();
+            paced_ = true;
+        }
+
+        // records and submits the frame in slot curr_frame_, whose previous submission has completed
+        void render_frame() {
+            paced_ = false;
+            frames_[curr_frame_].descriptors.reset();
+            release_retired(false);
+            if (use_bindless_) {
+                bindless_.reclaim(scheduler_.completed());
+            }
+            streamer_.pump();
+            profiler_.collect(curr_frame_);
+            if (headless() && frame_img_[curr_frame_] != NO_IMAGE) {
+                offscreen_.collect(frame_img_[curr_frame_]);
+            }
+
+            uint32_t img_idx;
+            if (headless()) {
+                img_idx = offscreen_.next_image();
+            } else {
+                auto res = vkAcquireNextImageKHR(
+                    dev_.logical, swap_chain_, UINT64_MAX,
+                    scheduler_.image_available(), VK_NULL_HANDLE, &img_idx
+                );
+                if (res == VK_ERROR_OUT_OF_DATE_KHR) {
+                    recreate_swapchain();
+                    return;
+                } else if (res != VK_SUCCESS) {
+                    throw VulkanError("Error aquiring Swapchain Image", res);
                 }
-                {
-                    auto res = vkCreateFence(dev_.logical, &fence_info, nullptr, &frame_done_[i]);
-                    if (res != VK_SUCCESS) {
-                        throw VulkanError("Error creating Fence", res);
-                    }
+            }
+
+            // the image may still be in use by an older frame than the one this slot waited for
+            if (image_serial_[img_idx] != 0) {
+                scheduler_.wait(image_serial_[img_idx]);
+                if (headless()) {
+                    offscreen_.collect(img_idx);
+                }
+            }
+            image_serial_[img_idx] = scheduler_.next_serial();
+            frame_img_[curr_frame_] = img_idx;
+
+            auto& frame = frames_[curr_frame_];
+            uniforms_.begin_frame(curr_frame_);
+            update_uniforms(frame);
+            if (auto res = vkResetCommandPool(dev_.logical, frame.cmd_pool, 0); res != VK_SUCCESS) {
+                throw VulkanError("Error resetting CommandPool", res);
+            }
+            auto record_start = std::chrono::steady_clock::now();
+            record_frame(frame, img_idx);
+            record_ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - record_start).count();
+
+            // offscreen images are ready as soon as their previous frame's serial completed
+            latency_.submitted(scheduler_.submit(queues_.graphics.queue, frame.cmd_buf), input_time_);
+            stall_ms_ = scheduler_.stall_ms();
+
+            if (headless()) {
+                offscreen_.mark_pending(img_idx);
+                scheduler_.end_frame();
+                return;
+            }
+
+            auto pres_info = VkPresentInfoKHR{};
+            pres_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+            VkSemaphore wait_semas[] = {scheduler_.render_finished()};
+            pres_info.waitSemaphoreCount = sizeof(wait_semas) / sizeof(wait_semas[0]);
+            pres_info.pWaitSemaphores = wait_semas;
+            VkSwapchainKHR swapchains[] = {swap_chain_};
+            pres_info.swapchainCount = sizeof(swapchains) / sizeof(swapchains[0]);
+            pres_info.pSwapchains = swapchains;
+            pres_info.pImageIndices = &img_idx;
+            pres_info.pResults = nullptr;
+
+            {
+                auto res = vkQueuePresentKHR(queues_.present.queue, &pres_info);
+                if ((res == VK_ERROR_OUT_OF_DATE_KHR) || (res == VK_SUBOPTIMAL_KHR) || window_resized_) {
+                    recreate_swapchain();
+                } else if (res != VK_SUCCESS) {
+                    throw VulkanError("Error presenting Queue", res);
                 }
             }
+            scheduler_.end_frame();
+        }
+
+
+        // shared by every frame, the uniform block is selected with a dynamic offset
+        VkDescriptorSet create_desc_set(VkImageView tex_view) {
+            auto writes = std::vector<DescriptorWrite>{
+                DescriptorWrite::buffer_info(
+                    0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, uniforms_.buffer(), sizeof(UniformBufferObject)
+                ),
+            };
+            if (!use_bindless_) {
+                writes.push_back(DescriptorWrite::image_info(1, tex_view, tex_sampler_));
+            }
+            return descriptors_.immutable_set(desc_set_layout_, writes);
         }
 
         void create_render_pass() {
@@ -888,33 +1538,66 @@ class VulkanRenderer {
             color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
             color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
             color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-            color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+            color_attachment.finalLayout = headless() ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+            // only needed within the pass, never stored
+            auto depth_attachment = VkAttachmentDescription{};
+            depth_attachment.format = depth_format_;
+            depth_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+            depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+            depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            depth_attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
             auto color_attachment_ref = VkAttachmentReference{};
             color_attachment_ref.attachment = 0;
             color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+            auto depth_attachment_ref = VkAttachmentReference{};
+            depth_attachment_ref.attachment = 1;
+            depth_attachment_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
             auto subpass = VkSubpassDescription{};
             subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
             subpass.colorAttachmentCount = 1;
             subpass.pColorAttachments = &color_attachment_ref;
+            subpass.pDepthStencilAttachment = &depth_attachment_ref;
 
+            // the depth buffer is shared by the frames in flight, the previous frame's depth writes
+            // have to be done before this one clears it; both fragment test stages write depth
             auto subpass_dep = VkSubpassDependency{};
             subpass_dep.srcSubpass = VK_SUBPASS_EXTERNAL;
-            subpass_dep.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-            subpass_dep.srcAccessMask = 0;
+            subpass_dep.srcStageMask = (
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT
+            );
+            subpass_dep.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
             subpass_dep.dstSubpass = 0;
-            subpass_dep.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-            subpass_dep.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
+            subpass_dep.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+            subpass_dep.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+            // headless frames are copied out right after the pass, the copy has to wait for the
+            // color writes and the transition to TRANSFER_SRC_OPTIMAL
+            auto readback_dep = VkSubpassDependency{};
+            readback_dep.srcSubpass = 0;
+            readback_dep.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            readback_dep.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            readback_dep.dstSubpass = VK_SUBPASS_EXTERNAL;
+            readback_dep.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+            readback_dep.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+            VkSubpassDependency dependencies[] = {subpass_dep, readback_dep};
+            VkAttachmentDescription attachments[] = {color_attachment, depth_attachment};
             auto renderpass_info = VkRenderPassCreateInfo{};
             renderpass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-            renderpass_info.attachmentCount = 1;
-            renderpass_info.pAttachments = &color_attachment;
+            renderpass_info.attachmentCount = sizeof(attachments) / sizeof(attachments[0]);
+            renderpass_info.pAttachments = attachments;
             renderpass_info.subpassCount = 1;
             renderpass_info.pSubpasses = &subpass;
-            renderpass_info.dependencyCount = 1;
-            renderpass_info.pDependencies = &subpass_dep;
+            renderpass_info.dependencyCount = headless() ? 2 : 1;
+            renderpass_info.pDependencies = dependencies;
 
             {
                 auto res = vkCreateRenderPass(dev_.logical, &renderpass_info, nullptr, &render_pass_);
@@ -928,7 +1611,7 @@ class VulkanRenderer {
             auto vb_binding = VkDescriptorSetLayoutBinding{};
             vb_binding.binding = 0;
             vb_binding.descriptorCount = 1;
-            vb_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            vb_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
             vb_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
             auto sampler_binding = VkDescriptorSetLayoutBinding{};
@@ -938,19 +1621,12 @@ class VulkanRenderer {
             sampler_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
             sampler_binding.pImmutableSamplers = nullptr;
 
-            auto bindings = std::array<VkDescriptorSetLayoutBinding,2>{vb_binding, sampler_binding};
-
-            auto dsl_info = VkDescriptorSetLayoutCreateInfo{};
-            dsl_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-            dsl_info.bindingCount = static_cast<uint32_t>(bindings.size());
-            dsl_info.pBindings = bindings.data();
-
-            {
-                auto res = vkCreateDescriptorSetLayout(dev_.logical, &dsl_info, nullptr, &desc_set_layout_);
-                if (res != VK_SUCCESS) {
-                    throw VulkanError("Error creating DescriptorSetLayout", res);
-                }
+            // bindless textures live in a set of their own
+            auto bindings = std::vector<VkDescriptorSetLayoutBinding>{vb_binding};
+            if (!use_bindless_) {
+                bindings.push_back(sampler_binding);
             }
+            desc_set_layout_ = descriptors_.layout(bindings);
         }
 
         VkExtent2D get_image_extent(const VkSurfaceCapabilitiesKHR& sfc_caps) const {
@@ -1004,6 +1680,10 @@ class VulkanRenderer {
                 VK_EXT_DEBUG_UTILS_EXTENSION_NAME,
             };
 
+            if (win_ == nullptr) {
+                return ret;
+            }
+
             uint32_t ext_cnt = 0;
             auto glfw_exts = glfwGetRequiredInstanceExtensions(&ext_cnt);
             for (; ext_cnt>0; --ext_cnt) {
@@ -1014,9 +1694,18 @@ class VulkanRenderer {
         }
 
         std::vector<const char*> get_device_extensions() const noexcept {
-            return std::vector<const char*>{
-                VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-            };
+            auto ret = std::vector<const char*>{};
+            if (!headless()) {
+                ret.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+            }
+            ret.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+            if (use_bindless_) {
+                ret.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+            }
+            if (host_query_reset_) {
+                ret.push_back(VK_EXT_HOST_QUERY_RESET_EXTENSION_NAME);
+            }
+            return ret;
         }
 
         GLFWwindow* win_;
@@ -1026,44 +1715,88 @@ class VulkanRenderer {
 #endif
         VkSurfaceKHR surf_;
         VulkanDevice dev_;
-        VkSwapchainKHR swap_chain_;
+        VkSwapchainKHR swap_chain_ = VK_NULL_HANDLE;
+        PipelineCache pipeline_cache_;
+        VkExtent2D offscreen_extent_;
+        uint32_t offscreen_img_cnt_ = 0;
+        OffscreenTarget offscreen_;
         struct {
             Queue graphics;
             Queue present;
+            Queue transfer;
         } queues_;
 
         struct {
             VkFormat format;
             VkExtent2D extent;
+            VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
         } swapchain_settings_;
+        PresentPolicy present_policy_ = PresentPolicy::power_saving;
+        FrameLimiter limiter_;
+        LatencyTracker latency_;
+        // set by pace_frame() until the frame is drawn
+        bool paced_ = false;
+        std::chrono::steady_clock::time_point input_time_;
         std::vector<VkImage> sc_imgs_;
         std::vector<VkImageView> sc_img_views_;
         std::vector<VkFramebuffer> sc_framebuffers_;
+        VkFormat depth_format_ = VK_FORMAT_UNDEFINED;
+        DepthTarget depth_;
         VkRenderPass render_pass_;
+        DescriptorCache descriptors_;
+        // owned by descriptors_
         VkDescriptorSetLayout desc_set_layout_;
         VkPipelineLayout pl_layout_;
         VkPipeline pipeline_;
-        VkCommandPool command_pool_;
-        VkDescriptorPool desc_pool_;
-        std::vector<VkCommandBuffer> command_buffers_;
-        std::vector<VkDescriptorSet> desc_sets_;
-
+        std::vector<FrameResources> frames_;
+        std::vector<InstanceData> instances_;
+        // the order instances are written in this frame, empty when unsorted
+        RenderQueue opaque_queue_;
+        bool sort_draws_ = true;
+        JobSystem jobs_;
+        uint32_t record_threads_ = 1;
+        double record_ms_ = 0.0;
+        double stall_ms_ = 0.0;
+        GpuCuller culler_;
+        bool gpu_culling_ = true;
+        VkDescriptorSet desc_set_;
+
+        DeviceAllocator allocator_;
+        StagingRing staging_;
+        UploadBatcher uploads_;
+        TextureStreamer streamer_;
         VkBuffer vert_buffer_;
-        VkDeviceMemory vert_mem_;
+        Allocation vert_mem_;
         VkBuffer idx_buffer_;
-        VkDeviceMemory idx_mem_;
-        std::vector<VkBuffer> uniform_buffers_;
-        std::vector<VkDeviceMemory> uniform_mems_;
-        VkImage tex_image_;
-        VkImageView tex_image_view_;
-        VkDeviceMemory tex_mem_;
+        Allocation idx_mem_;
+        uint32_t mesh_index_count_ = 0;
+        VkIndexType mesh_index_type_ = VK_INDEX_TYPE_UINT16;
+        VertexFormat mesh_vertex_format_ = VertexFormat::full;
+        UniformRing uniforms_;
+        std::vector<TextureImage> textures_;
+        BindlessTextures bindless_;
+        std::vector<uint32_t> texture_slots_;
+        bool bindless_requested_ = true;
+        bool use_bindless_ = false;
+        bool host_query_reset_ = false;
 
         VkSampler tex_sampler_;
 
-        std::vector<VkSemaphore> image_available_;
-        std::vector<VkSemaphore> render_finished_;
-        std::vector<VkFence> frame_done_;
-        std::vector<VkFence> frame_in_flight_;
-        uint8_t curr_frame_ = 0;
+        FrameScheduler scheduler_;
+        uint32_t frames_in_flight_ = FrameScheduler::DEFAULT_FRAMES_IN_FLIGHT;
+        // serial of the last frame that rendered to each swapchain image, 0 if none
+        std::vector<uint64_t> image_serial_;
+        std::vector<uint32_t> frame_img_;
+        std::deque<RetiredSwapchain> retired_;
+        uint32_t curr_frame_ = 0;
         bool window_resized_ = false;
+
+        GpuProfiler profiler_;
+        bool profiler_report_ = false;
+        SceneDesc scene_;
+        float fixed_dt_ = 0.0f;
+        uint64_t frame_cnt_ = 0;
+        std::chrono::steady_clock::time_point t0_;
+        UploadTicket init_upload_ticket_ = 0;
+        VkDeviceSize init_upload_bytes_ = 0;
 };
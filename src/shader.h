@@ -1,5 +1,7 @@
 #pragma once
 
+#include <span>
+
 #include <vulkan/vulkan.h>
 
 #include "utils.h"
@@ -18,3 +20,7 @@ VkShaderModule create_shader_module(VkDevice dev, const uint8_t* shader_code, si
 
     return ret;
 }
+
+inline VkShaderModule create_shader_module(VkDevice dev, std::span<const uint8_t> shader_code) {
+    return create_shader_module(dev, shader_code.data(), shader_code.size());
+}
@@ -0,0 +1,114 @@
+#version 450
+
+#define GROUP_SIZE 64
+
+layout (local_size_x = GROUP_SIZE) in;
+
+// count: every workgroup stores how many of its instances are visible
+// scan: one workgroup turns the counts into each workgroup's first output slot
+// scatter: visible instances are written at their workgroup's slot plus their rank in it
+#define PASS_COUNT 0
+#define PASS_SCAN 1
+#define PASS_SCATTER 2
+
+struct Instance {
+    mat4 model;
+    uvec4 material;
+};
+
+layout (std430, binding = 0) readonly buffer Instances {
+    Instance instances[];
+} src;
+
+layout (std430, binding = 1) writeonly buffer Visible {
+    Instance instances[];
+} dst;
+
+layout (std430, binding = 2) buffer Draw {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+} draw;
+
+layout (std430, binding = 3) buffer Groups {
+    uint offsets[];
+} groups;
+
+layout (push_constant) uniform Cull {
+    vec4 planes[6];
+    uint objectCount;
+    float radius;
+    uint pass;
+} cull;
+
+shared uint partial[GROUP_SIZE];
+
+bool is_visible(uint idx) {
+    if (idx >= cull.objectCount) {
+        return false;
+    }
+    mat4 model = src.instances[idx].model;
+    vec3 center = model[3].xyz;
+    float scale = max(max(length(model[0].xyz), length(model[1].xyz)), length(model[2].xyz));
+    float radius = cull.radius * scale;
+    for (int i = 0; i < 6; ++i) {
+        if (dot(cull.planes[i].xyz, center) + cull.planes[i].w < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// inclusive prefix sum over the workgroup, every invocation has to take part
+uint workgroup_scan(uint value) {
+    uint lid = gl_LocalInvocationID.x;
+    partial[lid] = value;
+    barrier();
+    for (uint offset = 1; offset < GROUP_SIZE; offset *= 2) {
+        uint add = (lid >= offset) ? partial[lid - offset] : 0;
+        barrier();
+        partial[lid] += add;
+        barrier();
+    }
+    return partial[lid];
+}
+
+void main() {
+    uint lid = gl_LocalInvocationID.x;
+    uint group = gl_WorkGroupID.x;
+
+    if (cull.pass == PASS_COUNT) {
+        uint total = workgroup_scan(is_visible(gl_GlobalInvocationID.x) ? 1 : 0);
+        if (lid == GROUP_SIZE - 1) {
+            groups.offsets[group] = total;
+        }
+    } else if (cull.pass == PASS_SCAN) {
+        // each invocation scans a contiguous run of workgroup counts
+        uint group_count = (cull.objectCount + GROUP_SIZE - 1) / GROUP_SIZE;
+        uint run = (group_count + GROUP_SIZE - 1) / GROUP_SIZE;
+        uint first = min(lid * run, group_count);
+        uint last = min(first + run, group_count);
+        uint sum = 0;
+        for (uint i = first; i < last; ++i) {
+            sum += groups.offsets[i];
+        }
+        uint offset = workgroup_scan(sum) - sum;
+        for (uint i = first; i < last; ++i) {
+            uint count = groups.offsets[i];
+            groups.offsets[i] = offset;
+            offset += count;
+        }
+        if (lid == GROUP_SIZE - 1) {
+            draw.instanceCount = offset;
+        }
+    } else {
+        uint idx = gl_GlobalInvocationID.x;
+        bool visible = is_visible(idx);
+        uint rank = workgroup_scan(visible ? 1 : 0);
+        if (visible) {
+            dst.instances[groups.offsets[group] + rank - 1] = src.instances[idx];
+        }
+    }
+}
@@ -1,20 +1,29 @@
 #version 450
 
 layout (binding = 0) uniform UniformBufferObject {
-    mat4 model;
     mat4 view;
     mat4 proj;
+    mat4 viewProj;
 } ubo;
 
-layout (location = 0) in vec2 position;
+layout (push_constant) uniform DrawPushConstants {
+    mat4 mvp;
+} draw;
+
+layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 color;
 layout (location = 2) in vec2 uv;
+layout (location = 3) in mat4 instanceModel;
+layout (location = 7) in uint instanceTexture;
 
 layout (location = 0) out vec3 fragColor;
 layout (location = 1) out vec2 fragTexCoord;
+layout (location = 2) flat out uint fragTexture;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(position, 0.0, 1.0);
+    // matrix-vector products only, left to right this would multiply the two matrices per vertex
+    gl_Position = draw.mvp * (instanceModel * vec4(position, 1.0));
     fragColor = color;
     fragTexCoord = uv;
+    fragTexture = instanceTexture;
 }
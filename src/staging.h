@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <stdexcept>
+
+#include <vulkan/vulkan.h>
+
+#include "allocator.h"
+#include "buffer.h"
+#include "device.h"
+#include "utils.h"
+
+// Persistently mapped upload buffer used as a ring. Regions handed out by
+// try_allocate() belong to the open batch; close_batch() tags it with the
+// ticket of the submission reading it, and reclaim() releases every batch up
+// to the last completed ticket, so steady-state uploads never allocate.
+class StagingRing {
+    private:
+        struct Batch {
+            VkDeviceSize end;
+            VkDeviceSize bytes;
+            uint64_t ticket;
+        };
+    public:
+        static constexpr VkDeviceSize DEFAULT_SIZE = 32 * 1024 * 1024;
+
+        struct Region {
+            VkBuffer buffer;
+            VkDeviceSize offset;
+            VkDeviceSize size;
+            void* data;
+        };
+
+        void init(VulkanDevice dev, DeviceAllocator& allocator, VkDeviceSize size = DEFAULT_SIZE) {
+            dev_ = dev;
+            capacity_ = size;
+
+            auto buf_desc = BufferDesc{};
+            buf_desc.size = size;
+            buf_desc.buf_usage_flags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+            buf_desc.mem_prop_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+            create_buffer(dev_, allocator, buf_desc, &buffer_, &mem_);
+        }
+
+        void destroy(DeviceAllocator& allocator) {
+            in_flight_.clear();
+            destroy_buffer(dev_, allocator, buffer_, mem_);
+        }
+
+        VkDeviceSize capacity() const noexcept {
+            return capacity_;
+        }
+
+        // largest upload that should go into a single region, bigger ones are split by the caller
+        VkDeviceSize max_chunk() const noexcept {
+            return capacity_ / 2;
+        }
+
+        bool has_in_flight() const noexcept {
+            return !in_flight_.empty();
+        }
+
+        uint64_t oldest_ticket() const noexcept {
+            return in_flight_.front().ticket;
+        }
+
+        // nullopt when the ring is full until older batches are reclaimed
+        std::optional<Region> try_allocate(VkDeviceSize size, VkDeviceSize alignment) {
+            if (size > capacity_) {
+                throw std::runtime_error("Staging allocation exceeds ring capacity");
+            }
+
+            auto offset = fit(size, std::max<VkDeviceSize>(alignment, 1));
+            if (!offset) {
+                return std::nullopt;
+            }
+            auto consumed = (*offset >= head_) ? (*offset + size - head_) : (capacity_ - head_ + *offset + size);
+            used_ += consumed;
+            batch_bytes_ += consumed;
+            head_ = *offset + size;
+
+            auto ret = Region{};
+            ret.buffer = buffer_;
+            ret.offset = *offset;
+            ret.size = size;
+            ret.data = static_cast<uint8_t*>(mem_.mapped) + *offset;
+            return ret;
+        }
+
+        // everything allocated since the last call is read by the submission behind `ticket`
+        void close_batch(uint64_t ticket) {
+            in_flight_.push_back(Batch{head_, batch_bytes_, ticket});
+            batch_bytes_ = 0;
+        }
+
+        void reclaim(uint64_t completed_ticket) {
+            while (!in_flight_.empty() && in_flight_.front().ticket <= completed_ticket) {
+                const auto& batch = in_flight_.front();
+                tail_ = batch.end;
+                used_ -= batch.bytes;
+                in_flight_.pop_front();
+            }
+            if (used_ == 0 && in_flight_.empty()) {
+                head_ = tail_ = 0;
+            }
+        }
+
+    private:
+        std::optional<VkDeviceSize> fit(VkDeviceSize size, VkDeviceSize alignment) const noexcept {
+            auto offset = align_up(head_, alignment);
+            if (used_ == 0) {
+                return (offset + size <= capacity_) ? std::optional<VkDeviceSize>{offset} : std::optional<VkDeviceSize>{0};
+            }
+            if (head_ > tail_) {
+                // in-use span is [tail, head): free space at the end, then wrap to the front
+                if (offset + size <= capacity_) {
+                    return offset;
+                }
+                if (size <= tail_) {
+                    return 0;
+                }
+                return std::nullopt;
+            }
+            // wrapped, free space is [head, tail)
+            if (offset + size <= tail_) {
+                return offset;
+            }
+            return std::nullopt;
+        }
+
+        VulkanDevice dev_;
+        VkBuffer buffer_ = VK_NULL_HANDLE;
+        Allocation mem_;
+        VkDeviceSize capacity_ = 0;
+        VkDeviceSize head_ = 0;
+        VkDeviceSize tail_ = 0;
+        VkDeviceSize used_ = 0;
+        VkDeviceSize batch_bytes_ = 0;
+        std::deque<Batch> in_flight_;
+};
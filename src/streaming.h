@@ -0,0 +1,258 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "allocator.h"
+#include "compressed.h"
+#include "device.h"
+#include "texture.h"
+#include "upload.h"
+#include "utils.h"
+
+using TextureId = uint32_t;
+
+// Loads textures in the background. request() queues a file for a pool of
+// decode threads; decoded images wait in a bounded queue, so decoding stalls
+// instead of piling up pixels faster than they can be uploaded. pump(),
+// called on the render thread once per frame, turns a few of them into
+// images through the UploadBatcher and invokes each texture's callback once
+// its upload batch has completed. Until then callers keep a placeholder
+// bound; the images stay owned by the streamer until destroy(). Files
+// ending in .dds or .ktx2 are loaded as cooked block-compressed textures,
+// anything else is decoded to RGBA8 and gets its mips on upload.
+class TextureStreamer {
+    public:
+        using Callback = std::function<void(TextureId, const TextureImage&)>;
+
+        static constexpr size_t DEFAULT_QUEUE_DEPTH = 8;
+
+        void init(
+            VulkanDevice dev, DeviceAllocator& allocator, UploadBatcher& uploads,
+            uint32_t worker_cnt, size_t queue_depth = DEFAULT_QUEUE_DEPTH
+        ) {
+            dev_ = dev;
+            allocator_ = &allocator;
+            uploads_ = &uploads;
+            queue_depth_ = std::max<size_t>(queue_depth, 1);
+            stop_ = false;
+            for (uint32_t i=0; i<std::max(worker_cnt, 1u); ++i) {
+                threads_.emplace_back([this]() { worker_main(); });
+            }
+        }
+
+        // the textures' last use must have completed
+        void destroy() {
+            {
+                auto lock = std::lock_guard(mutex_);
+                stop_ = true;
+            }
+            request_cv_.notify_all();
+            ready_cv_.notify_all();
+            for (auto& thread : threads_) {
+                thread.join();
+            }
+            threads_.clear();
+            requests_.clear();
+            ready_.clear();
+
+            for (auto& entry : entries_) {
+                destroy_texture_image(dev_, *allocator_, entry.tex);
+            }
+            entries_.clear();
+            uploading_.clear();
+        }
+
+        // queues `fpath` for decoding, `on_resident` runs inside a later pump() once the texture can be sampled
+        TextureId request(const std::filesystem::path& fpath, Callback on_resident) {
+            auto id = static_cast<TextureId>(entries_.size());
+            entries_.push_back(Entry{std::move(on_resident), TextureImage{}});
+            {
+                auto lock = std::lock_guard(mutex_);
+                requests_.push_back(Request{id, fpath});
+                ++outstanding_;
+            }
+            request_cv_.notify_one();
+            return id;
+        }
+
+        // uploads at most `max_uploads` decoded textures and completes finished ones, never blocks
+        void pump(uint32_t max_uploads = 4) {
+            for (uint32_t i=0; i<max_uploads; ++i) {
+                auto decoded = std::optional<Decoded>{};
+                {
+                    auto lock = std::lock_guard(mutex_);
+                    if (ready_.empty()) {
+                        break;
+                    }
+                    decoded = std::move(ready_.front());
+                    ready_.pop_front();
+                }
+                ready_cv_.notify_one();
+                upload(*decoded);
+            }
+            if (!uploading_.empty()) {
+                uploads_->flush();
+            }
+
+            while (!uploading_.empty() && uploads_->is_done(uploading_.front().ticket)) {
+                auto id = uploading_.front().id;
+                uploading_.pop_front();
+                complete(id);
+            }
+        }
+
+        // requests that have neither completed nor failed
+        size_t pending() {
+            auto lock = std::lock_guard(mutex_);
+            return outstanding_;
+        }
+
+        // pumps until every request so far has completed or failed, for tools and headless runs
+        void wait_all() {
+            while (pending() > 0) {
+                pump();
+                if (!uploading_.empty()) {
+                    uploads_->wait(uploading_.back().ticket);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+    private:
+        struct Request {
+            TextureId id;
+            std::filesystem::path fpath;
+        };
+        struct Decoded {
+            TextureId id;
+            std::filesystem::path fpath;
+            std::optional<Texture> pixels;
+            std::optional<CompressedTexture> cooked;
+        };
+        struct Entry {
+            Callback on_resident;
+            TextureImage tex;
+        };
+        struct InFlight {
+            TextureId id;
+            UploadTicket ticket;
+        };
+
+        static bool is_cooked(const std::filesystem::path& fpath) {
+            auto ext = fpath.extension();
+            return ext == ".dds" || ext == ".ktx2";
+        }
+
+        void worker_main() {
+            while (true) {
+                auto request = Request{};
+                {
+                    auto lock = std::unique_lock(mutex_);
+                    request_cv_.wait(lock, [this]() { return stop_ || !requests_.empty(); });
+                    if (stop_) {
+                        return;
+                    }
+                    request = std::move(requests_.front());
+                    requests_.pop_front();
+                }
+
+                auto decoded = Decoded{request.id, request.fpath, std::nullopt, std::nullopt};
+                try {
+                    if (is_cooked(request.fpath)) {
+                        decoded.cooked = CompressedTexture::load(request.fpath);
+                    } else {
+                        decoded.pixels = Texture(request.fpath);
+                    }
+                }
+                catch (const std::exception& ex) {
+                    std::cerr << "Error streaming " << request.fpath.string() << ": " << ex.what() << std::endl;
+                    finish_request();
+                    continue;
+                }
+
+                auto lock = std::unique_lock(mutex_);
+                ready_cv_.wait(lock, [this]() { return stop_ || ready_.size() < queue_depth_; });
+                if (stop_) {
+                    return;
+                }
+                ready_.push_back(std::move(decoded));
+            }
+        }
+
+        void upload(Decoded& decoded) {
+            auto img_desc = ImageDesc{};
+            img_desc.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+            img_desc.mem_props = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+            if (decoded.cooked) {
+                if (!CompressedTexture::device_supports(dev_.physical, decoded.cooked->format())) {
+                    std::cerr << "Error streaming " << decoded.fpath.string() << ": format not supported by the device" << std::endl;
+                    finish_request();
+                    return;
+                }
+                img_desc.width = decoded.cooked->width();
+                img_desc.height = decoded.cooked->height();
+                img_desc.mip_levels = decoded.cooked->mip_levels();
+                img_desc.format = decoded.cooked->format();
+            } else {
+                img_desc.width = decoded.pixels->width();
+                img_desc.height = decoded.pixels->height();
+                img_desc.mip_levels = mip_level_count(img_desc.width, img_desc.height);
+                img_desc.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            }
+
+            auto& tex = entries_[decoded.id].tex;
+            create_image(dev_, *allocator_, img_desc, &tex.image, &tex.mem);
+            tex.format = img_desc.format;
+            tex.mip_levels = img_desc.mip_levels;
+
+            auto ticket = decoded.cooked
+                ? uploads_->upload_image(tex.image, *decoded.cooked)
+                : uploads_->upload_image(tex.image, decoded.pixels->data(), img_desc.width, img_desc.height, img_desc.mip_levels);
+            uploading_.push_back(InFlight{decoded.id, ticket});
+        }
+
+        void complete(TextureId id) {
+            auto& entry = entries_[id];
+            entry.tex.view = create_image_view(dev_.logical, entry.tex.image, entry.tex.format, entry.tex.mip_levels);
+            if (entry.on_resident) {
+                entry.on_resident(id, entry.tex);
+            }
+            finish_request();
+        }
+
+        void finish_request() {
+            auto lock = std::lock_guard(mutex_);
+            --outstanding_;
+        }
+
+        VulkanDevice dev_;
+        DeviceAllocator* allocator_ = nullptr;
+        UploadBatcher* uploads_ = nullptr;
+        size_t queue_depth_ = DEFAULT_QUEUE_DEPTH;
+
+        std::vector<std::thread> threads_;
+        std::mutex mutex_;
+        std::condition_variable request_cv_;
+        std::condition_variable ready_cv_;
+        std::deque<Request> requests_;
+        std::deque<Decoded> ready_;
+        size_t outstanding_ = 0;
+        bool stop_ = false;
+
+        // render thread only
+        std::vector<Entry> entries_;
+        std::deque<InFlight> uploading_;
+};
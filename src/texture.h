@@ -1,24 +1,36 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
+#include <cstdlib>
 #include <memory>
+#include <new>
 #include <filesystem>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
 #include <vulkan/vulkan.h>
 
-#include "command.h"
+#include "allocator.h"
+#include "mapped_file.h"
 #include "utils.h"
 
 class Texture {
     public:
+        // decodes straight out of a read-only mapping of the file rather than through stdio
         Texture(const std::filesystem::path& fpath) : ptr_(nullptr, stbi_image_free) {
+            auto file = MappedFile(fpath, MappedFile::Access::whole);
             int channels;
             ptr_ = std::unique_ptr<uint8_t, decltype(&stbi_image_free)>(
                 reinterpret_cast<uint8_t*>(
-                    stbi_load(fpath.c_str(), &width_, &height_, &channels, STBI_rgb_alpha)
+                    stbi_load_from_memory(
+                        file.data(), static_cast<int>(file.size()), &width_, &height_, &channels, STBI_rgb_alpha
+                    )
                 ),
                 stbi_image_free
             );
@@ -28,6 +40,23 @@ class Texture {
             }
         }
 
+        // procedural RGBA checkerboard, used where reproducible content of a given size is needed
+        static Texture checkerboard(uint32_t size, uint32_t cells = 8) {
+            auto ret = Texture(size, size);
+            auto cell = std::max(size / std::max(cells, 1u), 1u);
+            auto dst = ret.ptr_.get();
+            for (uint32_t y=0; y<size; ++y) {
+                for (uint32_t x=0; x<size; ++x, dst += 4) {
+                    auto on = ((x / cell) + (y / cell)) % 2 == 0;
+                    dst[0] = on ? 230 : 40;
+                    dst[1] = static_cast<uint8_t>((x * 255) / size);
+                    dst[2] = static_cast<uint8_t>((y * 255) / size);
+                    dst[3] = 255;
+                }
+            }
+            return ret;
+        }
+
         size_t size() const noexcept {
             return width_ * height_ * 4;
         }
@@ -52,6 +81,16 @@ class Texture {
             return ret;
         }
     private:
+        Texture(uint32_t width, uint32_t height) :
+            ptr_(static_cast<uint8_t*>(std::malloc(size_t{width} * height * 4)), std::free),
+            width_(static_cast<int>(width)),
+            height_(static_cast<int>(height))
+        {
+            if (ptr_ == nullptr) {
+                throw std::bad_alloc();
+            }
+        }
+
         std::unique_ptr<uint8_t, decltype(&stbi_image_free)> ptr_;
         int width_;
         int height_;
@@ -62,6 +101,8 @@ struct ImageDesc {
     uint32_t height;
     VkImageUsageFlags usage;
     VkMemoryPropertyFlags mem_props;
+    uint32_t mip_levels = 1;
+    VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
 
     VkExtent3D extent() const noexcept {
         auto ret = VkExtent3D{};
@@ -72,14 +113,14 @@ struct ImageDesc {
     }
 };
 
-inline void create_image(VulkanDevice dev, const ImageDesc& desc, VkImage* img, VkDeviceMemory* mem) {
+inline void create_image(VulkanDevice dev, DeviceAllocator& allocator, const ImageDesc& desc, VkImage* img, Allocation* mem) {
     auto img_info = VkImageCreateInfo{};
     img_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     img_info.imageType = VK_IMAGE_TYPE_2D;
     img_info.extent = desc.extent();
-    img_info.mipLevels = 1;
+    img_info.mipLevels = desc.mip_levels;
     img_info.arrayLayers = 1;
-    img_info.format = VK_FORMAT_R8G8B8A8_SRGB;
+    img_info.format = desc.format;
     img_info.tiling = VK_IMAGE_TILING_OPTIMAL;
     img_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     img_info.usage = desc.usage;
@@ -95,29 +136,69 @@ inline void create_image(VulkanDevice dev, const ImageDesc& desc, VkImage* img,
 
     auto mem_reqs = VkMemoryRequirements{};
     vkGetImageMemoryRequirements(dev.logical, *img, &mem_reqs);
-    auto mem_props = VkPhysicalDeviceMemoryProperties{};
-    vkGetPhysicalDeviceMemoryProperties(dev.physical, &mem_props);
-
-    auto malloc_info = VkMemoryAllocateInfo{};
-    malloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    malloc_info.allocationSize = mem_reqs.size;
-    malloc_info.memoryTypeIndex = find_memory_type(
-        dev.physical, mem_reqs.memoryTypeBits,
-        desc.mem_props
-    );
+    *mem = allocator.allocate(mem_reqs, desc.mem_props, ResourceKind::optimal);
 
-    {
-        auto res = vkAllocateMemory(dev.logical, &malloc_info, nullptr, mem);
-        if (res != VK_SUCCESS) {
-            throw VulkanError("Error allocating Memory", res);
-        }
+    vkBindImageMemory(dev.logical, *img, mem->memory, mem->offset);
+}
+
+inline void destroy_image(VulkanDevice dev, DeviceAllocator& allocator, VkImage img, Allocation& mem) {
+    vkDestroyImage(dev.logical, img, nullptr);
+    allocator.free(mem);
+}
+
+// Sampled image with its view, as handed out by the texture streamer.
+struct TextureImage {
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    Allocation mem;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    uint32_t mip_levels = 0;
+};
+
+inline void destroy_texture_image(VulkanDevice dev, DeviceAllocator& allocator, TextureImage& tex) {
+    if (tex.image == VK_NULL_HANDLE) {
+        return;
+    }
+    vkDestroyImageView(dev.logical, tex.view, nullptr);
+    destroy_image(dev, allocator, tex.image, tex.mem);
+    tex = TextureImage{};
+}
+
+// levels of a full mip chain down to 1x1
+inline uint32_t mip_level_count(uint32_t width, uint32_t height) noexcept {
+    uint32_t ret = 1;
+    for (auto size = std::max(width, height); size > 1; size /= 2) {
+        ++ret;
+    }
+    return ret;
+}
+
+// stage and access of the work an image in `layout` is used for
+inline void layout_usage(VkImageLayout layout, VkPipelineStageFlags* stage, VkAccessFlags* access) {
+    switch (layout) {
+        case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+            *stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+            *access = VK_ACCESS_TRANSFER_WRITE_BIT;
+            break;
+        case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+            *stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+            *access = VK_ACCESS_TRANSFER_READ_BIT;
+            break;
+        case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+            *stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+            *access = VK_ACCESS_SHADER_READ_BIT;
+            break;
+        default:
+            *stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            *access = 0;
+            break;
     }
-    vkBindImageMemory(dev.logical, *img, *mem, 0);
 }
 
 inline void transition_image_layout(
     VkCommandBuffer cmd_buf, VkImage img,
-    VkImageLayout old_layout, VkImageLayout new_layout
+    VkImageLayout old_layout, VkImageLayout new_layout,
+    uint32_t base_mip = 0, uint32_t mip_cnt = 1
 ) {
     auto img_barrier = VkImageMemoryBarrier{};
     img_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -129,23 +210,12 @@ inline void transition_image_layout(
     img_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     img_barrier.subresourceRange.layerCount = 1;
     img_barrier.subresourceRange.baseArrayLayer = 0;
-    img_barrier.subresourceRange.levelCount = 1;
-    img_barrier.subresourceRange.baseMipLevel = 0;
+    img_barrier.subresourceRange.levelCount = mip_cnt;
+    img_barrier.subresourceRange.baseMipLevel = base_mip;
 
     VkPipelineStageFlags src_stage, dst_stage;
-    if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED) {
-        src_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        img_barrier.srcAccessMask = 0;
-
-        dst_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-        img_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    } else {
-        src_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-        img_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-        dst_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-        img_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    }
+    layout_usage(old_layout, &src_stage, &img_barrier.srcAccessMask);
+    layout_usage(new_layout, &dst_stage, &img_barrier.dstAccessMask);
 
     vkCmdPipelineBarrier(cmd_buf, src_stage, dst_stage, 0,
         0, nullptr,     // memory barriers
@@ -154,8 +224,114 @@ inline void transition_image_layout(
     );
 }
 
+// true if mip levels of `fmt` can be produced with linear-filtered blits
+inline bool supports_linear_blit(VkPhysicalDevice dev, VkFormat fmt) {
+    auto props = VkFormatProperties{};
+    vkGetPhysicalDeviceFormatProperties(dev, fmt, &props);
+    auto required = VkFormatFeatureFlags{
+        VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT
+    };
+    return (props.optimalTilingFeatures & required) == required;
+}
 
-inline VkImageView create_image_view(VkDevice dev, VkImage img, VkFormat fmt) {
+// Fills levels 1..mip_cnt-1 from level 0, each blitted from the one above.
+// Needs a graphics queue; expects every level in TRANSFER_DST_OPTIMAL and
+// leaves them all in SHADER_READ_ONLY_OPTIMAL.
+inline void generate_mipmaps(VkCommandBuffer cmd_buf, VkImage img, uint32_t width, uint32_t height, uint32_t mip_cnt) {
+    auto src_w = static_cast<int32_t>(width);
+    auto src_h = static_cast<int32_t>(height);
+    for (uint32_t level=1; level<mip_cnt; ++level) {
+        auto dst_w = std::max(src_w / 2, 1);
+        auto dst_h = std::max(src_h / 2, 1);
+        transition_image_layout(cmd_buf, img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, level - 1);
+
+        auto blit = VkImageBlit{};
+        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.mipLevel = level - 1;
+        blit.srcSubresource.baseArrayLayer = 0;
+        blit.srcSubresource.layerCount = 1;
+        blit.srcOffsets[0] = VkOffset3D{0, 0, 0};
+        blit.srcOffsets[1] = VkOffset3D{src_w, src_h, 1};
+        blit.dstSubresource = blit.srcSubresource;
+        blit.dstSubresource.mipLevel = level;
+        blit.dstOffsets[0] = VkOffset3D{0, 0, 0};
+        blit.dstOffsets[1] = VkOffset3D{dst_w, dst_h, 1};
+        vkCmdBlitImage(
+            cmd_buf,
+            img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1, &blit, VK_FILTER_LINEAR
+        );
+
+        transition_image_layout(cmd_buf, img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, level - 1);
+        src_w = dst_w;
+        src_h = dst_h;
+    }
+    transition_image_layout(cmd_buf, img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mip_cnt - 1);
+}
+
+// 2x2 box filter of tightly packed RGBA8 into a max(w/2,1) x max(h/2,1)
+// image, the CPU fallback for formats that can't be blitted. Filters the
+// stored values directly, i.e. without converting sRGB to linear first.
+inline void downsample_rgba8(const uint8_t* src, uint32_t width, uint32_t height, uint8_t* dst) {
+    auto dst_w = std::max(width / 2, 1u);
+    auto dst_h = std::max(height / 2, 1u);
+    for (uint32_t y=0; y<dst_h; ++y) {
+        auto row0 = src + size_t{std::min(2 * y, height - 1)} * width * 4;
+        auto row1 = src + size_t{std::min(2 * y + 1, height - 1)} * width * 4;
+        auto out = dst + size_t{y} * dst_w * 4;
+        uint32_t x = 0;
+#if defined(__SSE2__)
+        // four output pixels from two rows of eight input pixels, summed in 16 bits and rounded
+        // like the scalar loop so both produce the same values
+        if (width >= 2) {
+            auto zero = _mm_setzero_si128();
+            auto two = _mm_set1_epi16(2);
+            // the 2x2 sums of the two pixels a 16 byte column pair covers, as 8 lanes of 16 bits
+            auto box = [zero](__m128i top, __m128i bottom) {
+                auto lo = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+                auto hi = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+                lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+                hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+                return _mm_unpacklo_epi64(lo, hi);
+            };
+            for (; x + 4 <= width / 2; x += 4) {
+                auto a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+                auto a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8 + 16));
+                auto b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+                auto b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8 + 16));
+                auto sum0 = _mm_srli_epi16(_mm_add_epi16(box(a0, b0), two), 2);
+                auto sum1 = _mm_srli_epi16(_mm_add_epi16(box(a1, b1), two), 2);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), _mm_packus_epi16(sum0, sum1));
+            }
+        }
+#endif
+        for (; x<dst_w; ++x) {
+            auto x0 = std::min(2 * x, width - 1) * 4;
+            auto x1 = std::min(2 * x + 1, width - 1) * 4;
+            for (uint32_t c=0; c<4; ++c) {
+                auto sum = uint32_t{row0[x0 + c]} + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+                out[x * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+// the most precise depth format the device can render to, stencil is never used
+inline VkFormat choose_depth_format(VkPhysicalDevice dev) {
+    for (auto format : {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D16_UNORM}) {
+        auto props = VkFormatProperties{};
+        vkGetPhysicalDeviceFormatProperties(dev, format, &props);
+        if ((props.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) != 0) {
+            return format;
+        }
+    }
+    throw std::runtime_error("No supported depth attachment format");
+}
+
+inline VkImageView create_image_view(
+    VkDevice dev, VkImage img, VkFormat fmt, uint32_t mip_levels = 1, VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT
+) {
     auto ret = VkImageView{};
 
     auto iv_info = VkImageViewCreateInfo{};
@@ -163,8 +339,8 @@ inline VkImageView create_image_view(VkDevice dev, VkImage img, VkFormat fmt) {
     iv_info.image = img;
     iv_info.format = fmt;
     iv_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    iv_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    iv_info.subresourceRange.levelCount = 1;
+    iv_info.subresourceRange.aspectMask = aspect;
+    iv_info.subresourceRange.levelCount = mip_levels;
     iv_info.subresourceRange.baseMipLevel = 0;
     iv_info.subresourceRange.layerCount = 1;
     iv_info.subresourceRange.baseArrayLayer = 0;
@@ -198,7 +374,7 @@ inline VkSampler create_texture_sampler(VulkanDevice dev) {
     sampler_info.mipmapMode = VkSamplerMipmapMode::VK_SAMPLER_MIPMAP_MODE_LINEAR;
     sampler_info.mipLodBias = 0.0f;
     sampler_info.minLod = 0.0f;
-    sampler_info.maxLod = 0.0f;
+    sampler_info.maxLod = VK_LOD_CLAMP_NONE;
 
     if (auto res = vkCreateSampler(dev.logical, &sampler_info, nullptr, &ret); res != VK_SUCCESS) {
         throw VulkanError("Error creating Sampler", res);
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <vulkan/vulkan.h>
+
+#include "allocator.h"
+#include "buffer.h"
+#include "device.h"
+#include "utils.h"
+
+// One persistently mapped uniform buffer split into a region per frame in
+// flight. begin_frame() rewinds the frame's region once its fence has
+// signaled, push() copies a block into it at minUniformBufferOffsetAlignment
+// and returns the dynamic offset to bind it with, so per-draw uniforms need
+// neither map calls nor descriptor sets of their own. push() may be called
+// from several recording threads at once.
+class UniformRing {
+    public:
+        static constexpr VkDeviceSize DEFAULT_FRAME_SIZE = 256 * 1024;
+
+        void init(VulkanDevice dev, DeviceAllocator& allocator, uint32_t frame_cnt, VkDeviceSize frame_size = DEFAULT_FRAME_SIZE) {
+            dev_ = dev;
+
+            auto dev_props = VkPhysicalDeviceProperties{};
+            vkGetPhysicalDeviceProperties(dev_.physical, &dev_props);
+            alignment_ = std::max<VkDeviceSize>(dev_props.limits.minUniformBufferOffsetAlignment, 1);
+            frame_size_ = align(frame_size);
+
+            auto buf_desc = BufferDesc{};
+            buf_desc.size = frame_size_ * frame_cnt;
+            buf_desc.buf_usage_flags = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+            buf_desc.mem_prop_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+            create_buffer(dev_, allocator, buf_desc, &buffer_, &mem_);
+        }
+
+        void destroy(DeviceAllocator& allocator) {
+            destroy_buffer(dev_, allocator, buffer_, mem_);
+        }
+
+        VkBuffer buffer() const noexcept {
+            return buffer_;
+        }
+
+        // call once the previous submission of `frame` has completed
+        void begin_frame(uint32_t frame) noexcept {
+            base_ = frame * frame_size_;
+            head_.store(0, std::memory_order_relaxed);
+        }
+
+        // dynamic offset of a copy of `size` bytes from `data`, valid until the frame comes around again
+        uint32_t push(const void* data, VkDeviceSize size) {
+            auto aligned = align(size);
+            auto offset = head_.fetch_add(aligned, std::memory_order_relaxed);
+            if (offset + aligned > frame_size_) {
+                throw std::runtime_error("Uniform ring frame region exhausted");
+            }
+            std::memcpy(static_cast<uint8_t*>(mem_.mapped) + base_ + offset, data, size);
+            return static_cast<uint32_t>(base_ + offset);
+        }
+
+        template<typename T>
+        uint32_t push(const T& block) {
+            return push(&block, sizeof(T));
+        }
+
+    private:
+        VkDeviceSize align(VkDeviceSize size) const noexcept {
+            return (size + alignment_ - 1) / alignment_ * alignment_;
+        }
+
+        VulkanDevice dev_;
+        VkBuffer buffer_;
+        Allocation mem_;
+        VkDeviceSize alignment_ = 1;
+        VkDeviceSize frame_size_ = 0;
+        VkDeviceSize base_ = 0;
+        std::atomic<VkDeviceSize> head_ = 0;
+};
@@ -0,0 +1,566 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "buffer.h"
+#include "compressed.h"
+#include "device.h"
+#include "profiler.h"
+#include "staging.h"
+#include "texture.h"
+#include "utils.h"
+
+// Identifies one batched upload submission. Tickets increase monotonically,
+// so a batch is complete once the last completed ticket has reached it.
+using UploadTicket = uint64_t;
+
+// Records copies and layout transitions from many uploads into one command
+// buffer and submits them together with a fence. Callers keep the ticket of
+// the batch and only wait on it when they actually need the data on the CPU
+// side; later submissions to the graphics queue are ordered by the barriers
+// recorded at the end of each batch.
+//
+// When the transfer queue belongs to its own family, copies run there and
+// every resource is released to the graphics family at the end of the batch.
+// A small acquire submission on the graphics queue waits for the copies on a
+// semaphore and carries the matching acquire barriers.
+class UploadBatcher {
+    private:
+        struct Batch {
+            UploadTicket ticket;
+            VkCommandBuffer cmd_buf;
+            VkCommandBuffer acquire_cmd_buf;
+            VkSemaphore copied;
+            VkFence fence;
+            uint32_t timing_slot;
+            uint32_t timing_query;
+        };
+        struct MipChain {
+            VkImage image;
+            uint32_t width;
+            uint32_t height;
+            uint32_t levels;
+        };
+    public:
+        static constexpr uint32_t TIMED_BATCHES = 8;
+
+        // `host_query_reset` tells whether hostQueryReset is enabled on the device, without it
+        // batches on a dedicated transfer family are not timed, it cannot reset query pools
+        void init(
+            VulkanDevice dev, StagingRing& staging,
+            uint32_t tx_family, VkQueue tx_queue,
+            uint32_t gfx_family, VkQueue gfx_queue,
+            bool host_query_reset = false
+        ) {
+            dev_ = dev;
+            staging_ = &staging;
+            tx_family_ = tx_family;
+            tx_queue_ = tx_queue;
+            gfx_family_ = gfx_family;
+            gfx_queue_ = gfx_queue;
+
+            linear_blit_ = supports_linear_blit(dev_.physical, VK_FORMAT_R8G8B8A8_SRGB);
+            cmd_pool_ = create_pool(tx_family_);
+            if (!transfers_ownership() || host_query_reset) {
+                profiler_.init(dev_, tx_family_, TIMED_BATCHES, 1, transfers_ownership());
+            }
+            if (transfers_ownership()) {
+                acquire_pool_ = create_pool(gfx_family_);
+            }
+        }
+
+        void destroy() {
+            if (!in_flight_.empty()) {
+                wait(in_flight_.back().ticket);
+            }
+            if (open_.cmd_buf != VK_NULL_HANDLE) {
+                vkEndCommandBuffer(open_.cmd_buf);
+                free_batches_.push_back(open_);
+            }
+            for (const auto& batch : free_batches_) {
+                vkFreeCommandBuffers(dev_.logical, cmd_pool_, 1, &batch.cmd_buf);
+                if (batch.acquire_cmd_buf != VK_NULL_HANDLE) {
+                    vkFreeCommandBuffers(dev_.logical, acquire_pool_, 1, &batch.acquire_cmd_buf);
+                    vkDestroySemaphore(dev_.logical, batch.copied, nullptr);
+                }
+                vkDestroyFence(dev_.logical, batch.fence, nullptr);
+            }
+            free_batches_.clear();
+            vkDestroyCommandPool(dev_.logical, cmd_pool_, nullptr);
+            profiler_.destroy();
+            if (acquire_pool_ != VK_NULL_HANDLE) {
+                vkDestroyCommandPool(dev_.logical, acquire_pool_, nullptr);
+            }
+        }
+
+        // times each batch's copies under the scope "upload"
+        GpuProfiler& gpu_profiler() noexcept {
+            return profiler_;
+        }
+
+        // true when copies run on a dedicated transfer family
+        bool transfers_ownership() const noexcept {
+            return tx_family_ != gfx_family_;
+        }
+
+        // command buffer of the open batch, for recording custom transfer work
+        VkCommandBuffer cmd_buf() {
+            if (open_.cmd_buf == VK_NULL_HANDLE) {
+                begin_batch();
+            }
+            return open_.cmd_buf;
+        }
+
+        // total bytes copied through staging since init
+        VkDeviceSize bytes_uploaded() const noexcept {
+            return bytes_uploaded_;
+        }
+
+        // seconds spent staging copies, submitting and waiting for batches since init; work
+        // the caller does between uploads (decoding, generating pixels) is not counted
+        double busy_seconds() const noexcept {
+            return std::chrono::duration<double>(busy_).count();
+        }
+
+        // ticket the currently recorded work will complete with
+        UploadTicket ticket() const noexcept {
+            return next_ticket_;
+        }
+
+        // dst_stage/dst_access describe the first use of the data after the upload
+        UploadTicket upload_buffer(
+            VkBuffer dst_buf, VkDeviceSize dst_offset, const void* data, VkDeviceSize size,
+            VkPipelineStageFlags dst_stage, VkAccessFlags dst_access
+        ) {
+            auto busy = BusyScope(this);
+            auto src = static_cast<const uint8_t*>(data);
+            for (VkDeviceSize done = 0; done < size;) {
+                auto chunk = std::min(size - done, staging_->max_chunk());
+                auto region = allocate_staging(chunk, 4);
+                std::memcpy(region.data, src + done, static_cast<size_t>(chunk));
+                copy_buffer(cmd_buf(), region.buffer, region.offset, dst_buf, dst_offset + done, chunk);
+                done += chunk;
+                bytes_uploaded_ += chunk;
+            }
+
+            if (transfers_ownership()) {
+                auto barrier = VkBufferMemoryBarrier{};
+                barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+                barrier.srcQueueFamilyIndex = tx_family_;
+                barrier.dstQueueFamilyIndex = gfx_family_;
+                barrier.buffer = dst_buf;
+                barrier.offset = dst_offset;
+                barrier.size = size;
+
+                barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.dstAccessMask = 0;
+                buf_releases_.push_back(barrier);
+
+                barrier.srcAccessMask = 0;
+                barrier.dstAccessMask = dst_access;
+                buf_acquires_.push_back(barrier);
+            }
+            dst_stages_ |= dst_stage;
+            dst_access_ |= dst_access;
+            return next_ticket_;
+        }
+
+        // RGBA8 pixels, split into bands of whole rows; leaves the image in SHADER_READ_ONLY_OPTIMAL.
+        // Levels below 0 are blitted on the graphics queue where the format allows it and
+        // downsampled on the CPU and uploaded otherwise; blits need TRANSFER_SRC usage.
+        UploadTicket upload_image(VkImage dst_img, const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t mip_levels = 1) {
+            auto blit = (mip_levels > 1) && linear_blit_;
+
+            transition_image_layout(cmd_buf(), dst_img, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, mip_levels);
+            upload_level(dst_img, 0, pixels, width, height);
+            if (mip_levels > 1 && !blit) {
+                auto src = std::vector<uint8_t>(pixels, pixels + size_t{width} * height * 4);
+                auto dst = std::vector<uint8_t>{};
+                for (uint32_t level=1; level<mip_levels; ++level) {
+                    auto dst_w = std::max(width / 2, 1u);
+                    auto dst_h = std::max(height / 2, 1u);
+                    dst.resize(size_t{dst_w} * dst_h * 4);
+                    downsample_rgba8(src.data(), width, height, dst.data());
+                    upload_level(dst_img, level, dst.data(), dst_w, dst_h);
+                    std::swap(src, dst);
+                    width = dst_w;
+                    height = dst_h;
+                }
+            }
+
+            finish_image(dst_img, width, height, mip_levels, blit);
+            return next_ticket_;
+        }
+
+        // every level of a precooked block-compressed texture, copied as stored
+        UploadTicket upload_image(VkImage dst_img, const CompressedTexture& tex) {
+            transition_image_layout(cmd_buf(), dst_img, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, tex.mip_levels());
+            for (uint32_t level=0; level<tex.mip_levels(); ++level) {
+                const auto& lvl = tex.level(level);
+                upload_level(
+                    dst_img, level, tex.level_data(level), lvl.width, lvl.height,
+                    CompressedTexture::BLOCK_DIM, CompressedTexture::block_bytes(tex.format())
+                );
+                tex.release_level(level);
+            }
+            finish_image(dst_img, tex.width(), tex.height(), tex.mip_levels(), false);
+            return next_ticket_;
+        }
+
+        // submits the open batch, returns its ticket (or the last one if nothing was recorded)
+        UploadTicket flush() {
+            if (open_.cmd_buf == VK_NULL_HANDLE) {
+                return next_ticket_ - 1;
+            }
+            auto busy = BusyScope(this);
+
+            if (transfers_ownership()) {
+                submit_with_ownership_transfer();
+            } else {
+                submit_single_queue();
+            }
+
+            staging_->close_batch(open_.ticket);
+            in_flight_.push_back(open_);
+            open_ = Batch{};
+            dst_stages_ = 0;
+            dst_access_ = 0;
+            return next_ticket_++;
+        }
+
+        // retires finished batches, never blocks
+        void poll() {
+            while (!in_flight_.empty() && vkGetFenceStatus(dev_.logical, in_flight_.front().fence) == VK_SUCCESS) {
+                completed_ = in_flight_.front().ticket;
+                if (in_flight_.front().timing_query != GpuProfiler::NO_QUERY) {
+                    profiler_.collect(in_flight_.front().timing_slot);
+                }
+                free_batches_.push_back(in_flight_.front());
+                in_flight_.pop_front();
+            }
+            staging_->reclaim(completed_);
+        }
+
+        bool is_done(UploadTicket ticket) {
+            poll();
+            return ticket <= completed_;
+        }
+
+        void wait(UploadTicket ticket) {
+            auto busy = BusyScope(this);
+            if (ticket >= next_ticket_) {
+                flush();
+            }
+            if (ticket <= completed_) {
+                return;
+            }
+            for (const auto& batch : in_flight_) {
+                if (batch.ticket == ticket) {
+                    if (auto res = vkWaitForFences(dev_.logical, 1, &batch.fence, VK_TRUE, UINT64_MAX); res != VK_SUCCESS) {
+                        throw VulkanError("Error waiting for upload Fence", res);
+                    }
+                    break;
+                }
+            }
+            poll();
+        }
+
+    private:
+        VkCommandPool create_pool(uint32_t family) {
+            auto pool_info = VkCommandPoolCreateInfo{};
+            pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            pool_info.queueFamilyIndex = family;
+            pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+            auto ret = VkCommandPool{};
+            if (auto res = vkCreateCommandPool(dev_.logical, &pool_info, nullptr, &ret); res != VK_SUCCESS) {
+                throw VulkanError("Error creating CommandPool", res);
+            }
+            return ret;
+        }
+
+        VkCommandBuffer allocate_cmd_buf(VkCommandPool pool) {
+            auto cmd_buf_info = VkCommandBufferAllocateInfo{};
+            cmd_buf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            cmd_buf_info.commandPool = pool;
+            cmd_buf_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            cmd_buf_info.commandBufferCount = 1;
+
+            auto ret = VkCommandBuffer{};
+            if (auto res = vkAllocateCommandBuffers(dev_.logical, &cmd_buf_info, &ret); res != VK_SUCCESS) {
+                throw VulkanError("Error allocating CommandBuffer", res);
+            }
+            return ret;
+        }
+
+        static void begin_one_time(VkCommandBuffer cmd_buf) {
+            auto begin_info = VkCommandBufferBeginInfo{};
+            begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            if (auto res = vkBeginCommandBuffer(cmd_buf, &begin_info); res != VK_SUCCESS) {
+                throw VulkanError("Error beginning CommandBuffer", res);
+            }
+        }
+
+        static void end(VkCommandBuffer cmd_buf) {
+            if (auto res = vkEndCommandBuffer(cmd_buf); res != VK_SUCCESS) {
+                throw VulkanError("Error ending CommandBuffer", res);
+            }
+        }
+
+        void begin_batch() {
+            if (!free_batches_.empty()) {
+                open_ = free_batches_.back();
+                free_batches_.pop_back();
+                vkResetFences(dev_.logical, 1, &open_.fence);
+                vkResetCommandBuffer(open_.cmd_buf, 0);
+                if (open_.acquire_cmd_buf != VK_NULL_HANDLE) {
+                    vkResetCommandBuffer(open_.acquire_cmd_buf, 0);
+                }
+            } else {
+                open_ = Batch{};
+                open_.cmd_buf = allocate_cmd_buf(cmd_pool_);
+
+                auto fence_info = VkFenceCreateInfo{};
+                fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+                if (auto res = vkCreateFence(dev_.logical, &fence_info, nullptr, &open_.fence); res != VK_SUCCESS) {
+                    throw VulkanError("Error creating Fence", res);
+                }
+
+                if (transfers_ownership()) {
+                    open_.acquire_cmd_buf = allocate_cmd_buf(acquire_pool_);
+
+                    auto sema_info = VkSemaphoreCreateInfo{};
+                    sema_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+                    if (auto res = vkCreateSemaphore(dev_.logical, &sema_info, nullptr, &open_.copied); res != VK_SUCCESS) {
+                        throw VulkanError("Error creating Semaphore", res);
+                    }
+                }
+            }
+            open_.ticket = next_ticket_;
+            begin_one_time(open_.cmd_buf);
+
+            // a timing slot is only reused once the batch that last wrote it has completed
+            open_.timing_slot = static_cast<uint32_t>(open_.ticket % TIMED_BATCHES);
+            open_.timing_query = GpuProfiler::NO_QUERY;
+            if (slot_tickets_[open_.timing_slot] <= completed_) {
+                slot_tickets_[open_.timing_slot] = open_.ticket;
+                profiler_.begin(open_.cmd_buf, open_.timing_slot);
+                open_.timing_query = profiler_.begin_scope(open_.cmd_buf, open_.timing_slot, "upload");
+            }
+        }
+
+        void submit_single_queue() {
+            profiler_.end_scope(open_.cmd_buf, open_.timing_query);
+            if (dst_stages_ != 0 && dst_access_ != 0) {
+                auto barrier = VkMemoryBarrier{};
+                barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.dstAccessMask = dst_access_;
+                vkCmdPipelineBarrier(open_.cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stages_, 0,
+                    1, &barrier,
+                    0, nullptr,
+                    0, nullptr
+                );
+            }
+            end(open_.cmd_buf);
+
+            auto submit_info = VkSubmitInfo{};
+            submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submit_info.commandBufferCount = 1;
+            submit_info.pCommandBuffers = &open_.cmd_buf;
+            if (auto res = vkQueueSubmit(tx_queue_, 1, &submit_info, open_.fence); res != VK_SUCCESS) {
+                throw VulkanError("Error submitting Queue", res);
+            }
+        }
+
+        void submit_with_ownership_transfer() {
+            profiler_.end_scope(open_.cmd_buf, open_.timing_query);
+            if (!buf_releases_.empty() || !img_releases_.empty()) {
+                vkCmdPipelineBarrier(open_.cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                    0, nullptr,
+                    static_cast<uint32_t>(buf_releases_.size()), buf_releases_.data(),
+                    static_cast<uint32_t>(img_releases_.size()), img_releases_.data()
+                );
+            }
+            end(open_.cmd_buf);
+
+            begin_one_time(open_.acquire_cmd_buf);
+            auto acquire_stages = (dst_stages_ != 0) ? dst_stages_ : VkPipelineStageFlags{VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT};
+            if (!buf_acquires_.empty() || !img_acquires_.empty()) {
+                vkCmdPipelineBarrier(open_.acquire_cmd_buf, acquire_stages, acquire_stages, 0,
+                    0, nullptr,
+                    static_cast<uint32_t>(buf_acquires_.size()), buf_acquires_.data(),
+                    static_cast<uint32_t>(img_acquires_.size()), img_acquires_.data()
+                );
+            }
+            for (const auto& chain : mip_chains_) {
+                generate_mipmaps(open_.acquire_cmd_buf, chain.image, chain.width, chain.height, chain.levels);
+            }
+            end(open_.acquire_cmd_buf);
+            mip_chains_.clear();
+
+            buf_releases_.clear();
+            img_releases_.clear();
+            buf_acquires_.clear();
+            img_acquires_.clear();
+
+            auto copy_info = VkSubmitInfo{};
+            copy_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            copy_info.commandBufferCount = 1;
+            copy_info.pCommandBuffers = &open_.cmd_buf;
+            copy_info.signalSemaphoreCount = 1;
+            copy_info.pSignalSemaphores = &open_.copied;
+            if (auto res = vkQueueSubmit(tx_queue_, 1, &copy_info, VK_NULL_HANDLE); res != VK_SUCCESS) {
+                throw VulkanError("Error submitting transfer Queue", res);
+            }
+
+            auto acquire_info = VkSubmitInfo{};
+            acquire_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            acquire_info.waitSemaphoreCount = 1;
+            acquire_info.pWaitSemaphores = &open_.copied;
+            acquire_info.pWaitDstStageMask = &acquire_stages;
+            acquire_info.commandBufferCount = 1;
+            acquire_info.pCommandBuffers = &open_.acquire_cmd_buf;
+            if (auto res = vkQueueSubmit(gfx_queue_, 1, &acquire_info, open_.fence); res != VK_SUCCESS) {
+                throw VulkanError("Error submitting Queue", res);
+            }
+        }
+
+        // copies in bands of whole block rows, the defaults describe RGBA8 texels
+        void upload_level(
+            VkImage dst_img, uint32_t level, const uint8_t* pixels, uint32_t width, uint32_t height,
+            uint32_t block_dim = 1, uint32_t block_bytes = 4
+        ) {
+            auto block_rows = (height + block_dim - 1) / block_dim;
+            auto row_size = VkDeviceSize{(width + block_dim - 1) / block_dim} * block_bytes;
+            auto rows_per_chunk = static_cast<uint32_t>(std::max<VkDeviceSize>(staging_->max_chunk() / row_size, 1));
+            auto busy = BusyScope(this);
+
+            for (uint32_t row = 0; row < block_rows;) {
+                auto rows = std::min(rows_per_chunk, block_rows - row);
+                auto region = allocate_staging(row_size * rows, 16);
+                std::memcpy(region.data, pixels + row * row_size, static_cast<size_t>(row_size * rows));
+                auto y = row * block_dim;
+                copy_buffer_to_image(
+                    cmd_buf(), region.buffer, region.offset, dst_img,
+                    VkOffset3D{0, static_cast<int32_t>(y), 0}, VkExtent3D{width, std::min(rows * block_dim, height - y), 1}, level
+                );
+                row += rows;
+                bytes_uploaded_ += row_size * rows;
+            }
+        }
+
+        // leaves every level in SHADER_READ_ONLY_OPTIMAL for the graphics queue, blitting the chain first if `blit`
+        void finish_image(VkImage dst_img, uint32_t width, uint32_t height, uint32_t mip_levels, bool blit) {
+            if (!transfers_ownership()) {
+                if (blit) {
+                    generate_mipmaps(cmd_buf(), dst_img, width, height, mip_levels);
+                } else {
+                    transition_image_layout(cmd_buf(), dst_img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0, mip_levels);
+                }
+                return;
+            }
+
+            // the layout transition happens as part of the ownership transfer, blits
+            // need a graphics queue and are recorded after the acquire
+            auto barrier = VkImageMemoryBarrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = blit ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barrier.srcQueueFamilyIndex = tx_family_;
+            barrier.dstQueueFamilyIndex = gfx_family_;
+            barrier.image = dst_img;
+            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            barrier.subresourceRange.baseMipLevel = 0;
+            barrier.subresourceRange.levelCount = mip_levels;
+            barrier.subresourceRange.baseArrayLayer = 0;
+            barrier.subresourceRange.layerCount = 1;
+
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+            img_releases_.push_back(barrier);
+
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = blit ? (VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT) : VK_ACCESS_SHADER_READ_BIT;
+            img_acquires_.push_back(barrier);
+
+            if (blit) {
+                mip_chains_.push_back(MipChain{dst_img, width, height, mip_levels});
+                dst_stages_ |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+            }
+            dst_stages_ |= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        }
+
+        // adds the time until it goes out of scope to busy_, nested scopes count once
+        class BusyScope {
+            public:
+                explicit BusyScope(UploadBatcher* owner) noexcept : owner_{owner} {
+                    if (owner_->busy_depth_++ == 0) {
+                        owner_->busy_start_ = std::chrono::steady_clock::now();
+                    }
+                }
+                BusyScope(const BusyScope&) = delete;
+                BusyScope& operator=(const BusyScope&) = delete;
+                ~BusyScope() {
+                    if (--owner_->busy_depth_ == 0) {
+                        owner_->busy_ += std::chrono::steady_clock::now() - owner_->busy_start_;
+                    }
+                }
+
+            private:
+                UploadBatcher* owner_;
+        };
+
+        // a full ring first waits for the oldest batch; if the open batch alone fills it, it is submitted early
+        StagingRing::Region allocate_staging(VkDeviceSize size, VkDeviceSize alignment) {
+            while (true) {
+                if (auto region = staging_->try_allocate(size, alignment)) {
+                    return *region;
+                }
+                if (!staging_->has_in_flight()) {
+                    flush();
+                }
+                wait(staging_->oldest_ticket());
+            }
+        }
+
+        VulkanDevice dev_;
+        StagingRing* staging_ = nullptr;
+        uint32_t tx_family_;
+        VkQueue tx_queue_;
+        uint32_t gfx_family_;
+        VkQueue gfx_queue_;
+        VkCommandPool cmd_pool_ = VK_NULL_HANDLE;
+        VkCommandPool acquire_pool_ = VK_NULL_HANDLE;
+
+        Batch open_ = Batch{};
+        std::deque<Batch> in_flight_;
+        std::vector<Batch> free_batches_;
+        UploadTicket next_ticket_ = 1;
+        UploadTicket completed_ = 0;
+        VkDeviceSize bytes_uploaded_ = 0;
+        std::chrono::steady_clock::duration busy_ = std::chrono::steady_clock::duration::zero();
+        std::chrono::steady_clock::time_point busy_start_;
+        uint32_t busy_depth_ = 0;
+        GpuProfiler profiler_;
+        std::array<UploadTicket, TIMED_BATCHES> slot_tickets_ = {};
+
+        VkPipelineStageFlags dst_stages_ = 0;
+        VkAccessFlags dst_access_ = 0;
+        std::vector<VkBufferMemoryBarrier> buf_releases_;
+        std::vector<VkBufferMemoryBarrier> buf_acquires_;
+        std::vector<VkImageMemoryBarrier> img_releases_;
+        std::vector<VkImageMemoryBarrier> img_acquires_;
+        // images whose levels are blitted once acquired on the graphics queue
+        std::vector<MipChain> mip_chains_;
+        bool linear_blit_ = false;
+};
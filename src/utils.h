@@ -1,28 +1,14 @@
 #pragma once
 
 #include <cstdint>
-#include <istream>
-#include <fstream>
 #include <filesystem>
 #include <optional>
-#include <vector>
 
-inline std::vector<uint8_t> load_file(std::istream& ins) {
-    ins.seekg(0, std::ios::end);
-    auto fsize = ins.tellg();
-    auto ret = std::vector<uint8_t>(fsize);
-    ins.seekg(0);
+#include "mapped_file.h"
 
-    ins.read(reinterpret_cast<char*>(ret.data()), fsize);
-    return ret;
-}
-
-inline std::vector<uint8_t> load_file(const std::filesystem::path& fpath) {
-    if (!std::filesystem::exists(fpath)) {
-        throw std::runtime_error("file not found");
-    }
-    auto ifs = std::ifstream(fpath);
-    return load_file(ifs);
+// maps the whole file for reading instead of copying it into memory
+inline MappedFile load_file(const std::filesystem::path& fpath, MappedFile::Access access = MappedFile::Access::whole) {
+    return MappedFile(fpath, access);
 }
 
 template <typename P, typename C>